@@ -14,3 +14,8 @@ for %%f in (%SHADER_DIR%\*.comp) do (
     echo Compiling %%f to !OUTPUT_FILE!
     %GLSLC% %%f -o !OUTPUT_FILE!
 )
+
+@REM Variant of the path tracer using hardware ray queries, only loaded on devices supporting them
+set RAY_QUERY_OUTPUT_FILE="%COMPILED_SHADER_BUILD_DIR%\path_tracing_ray_query.comp.spv"
+echo Compiling the ray query variant of %SHADER_DIR%\path_tracing.comp to %RAY_QUERY_OUTPUT_FILE%
+%GLSLC% --target-env=vulkan1.2 -DRAY_QUERY %SHADER_DIR%\path_tracing.comp -o %RAY_QUERY_OUTPUT_FILE%
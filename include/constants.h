@@ -14,6 +14,12 @@
 constexpr uint32_t WIDTH = 1700;
 constexpr uint32_t HEIGHT = 950;
 constexpr uint32_t FRAME_OVERLAP = 2;
+// environment radiance is clamped to this value in path_tracing.comp, the sampling distribution must match
+constexpr float MAX_ENV_MAP_VALUE = 5.0f;
+// size of the bindless texture array of the path tracer
+constexpr uint32_t MAX_TEXTURES = 30;
+// coarsest dynamic resolution, one traced pixel per block of MAX_INTERLEAVE x MAX_INTERLEAVE
+constexpr uint32_t MAX_INTERLEAVE = 4;
 
 const std::vector<const char*> VALIDATIONS_LAYERS = {
     "VK_LAYER_KHRONOS_validation",
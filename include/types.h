@@ -3,6 +3,7 @@
 #include <vulkan/vulkan.h>
 // double ended queue
 #include <deque>
+#include <compare>
 #include <functional>
 #include <optional>
 #include <glm/glm.hpp>
@@ -83,15 +84,64 @@ namespace renderer
     struct CameraUniform
     {
         glm::vec3 position;
-        float padding;
+        // first sample index of the accumulation, the processes of a distributed render each get their own range
+        uint32_t sampleOffset = 0;
         glm::mat4 invView;
         glm::mat4 invProj;
+        // camera of the previous frame, used to reproject the accumulated history
+        glm::mat4 prevView;
+        glm::mat4 prevProj;
+        // window of the image plane covered by the draw image, offset in xy and size in zw, see Renderer::renderTiled
+        glm::vec4 crop = {0.0f, 0.0f, 1.0f, 1.0f};
+    };
+
+    // Outputs of the path tracer, the AOVs are taken at the first hit. Must match post_processing.comp.
+    enum class Aov : uint32_t
+    {
+        Beauty = 0, // accumulated radiance
+        Albedo,
+        Normal, // shading normal
+        Depth, // linear depth along the view direction, 0 for the environment
+        MeshId, // index of the mesh in the scene, NO_AOV_ID for the environment
+        MaterialId,
+        HitCount, // surface hits per path
+        Count
     };
 
+    constexpr uint32_t NO_AOV_ID = 0xFFFFFFFF;
+
     struct PostProcessingPushConstants
     {
         uint32_t method = 1;
         float exposure = 1.0;
+        uint32_t denoised = 0; // reads the output of the denoiser instead of the accumulated radiance
+        Aov aov = Aov::Beauty; // displayed output, AOVs skip the tonemapping
+    };
+
+    // Must match the stages of denoising.comp
+    enum class DenoisingStage : uint32_t
+    {
+        Prepare = 0, // divides the radiance by the albedo and estimates its variance
+        Filter, // one a-trous iteration
+        Final, // last iteration, multiplies the albedo back in
+    };
+
+    struct DenoisingPushConstants
+    {
+        DenoisingStage stage = DenoisingStage::Prepare;
+        int32_t step = 1; // pixels between the taps of the iteration
+        uint32_t source = 0; // filter images read and written by the iteration
+        uint32_t target = 0;
+        float phiColor = 4.0f; // luminance tolerance in standard deviations of the noise
+        float phiNormal = 128.0f; // exponent of the normal similarity
+        float phiDepth = 0.1f; // relative depth tolerance per step
+    };
+
+    struct ReprojectionPushConstants
+    {
+        uint32_t maxFrames = 32; // frames the reprojected history counts for at most, limits the lag of highlights
+        float depthTolerance = 0.05f; // relative depth difference above which the history is disoccluded
+        float normalTolerance = 0.9f; // minimal cosine between the history normal and the current one
     };
 }
 
@@ -107,17 +157,6 @@ namespace path_tracing
         float padding3;
     }; // 32 bytes
 
-    struct TextureIterationSettings
-    {
-        int index;
-        bool sRGB;
-    };
-    struct TextureCreateSettings
-    {
-        std::string name;
-        bool sRGB;
-    };
-
     struct Material
     {
         glm::vec3 color = glm::vec3(1.0f);
@@ -128,23 +167,6 @@ namespace path_tracing
         std::optional<std::string> roughnessMap = "assets/defaults/default_texture.png";
         std::optional<std::string> metallicMap = "assets/defaults/default_texture.png";
         std::optional<std::string> normalMap;
-
-        static int handleMapProperty(const std::optional<std::string>& property,
-                                     std::unordered_map<std::string, TextureIterationSettings>& map, int& currentIndex,
-                                     bool sRGB = false)
-        {
-            if (property.has_value())
-            {
-                const std::string& key = property.value();
-                if (map.contains(key))
-                    return map.at(key).index;
-
-                TextureIterationSettings t = {.index = ++currentIndex, .sRGB = sRGB};
-                map.emplace(key, t);
-                return currentIndex;
-            }
-            return -1;
-        }
     };
 
     struct GPUMaterial
@@ -170,36 +192,74 @@ namespace path_tracing
     }; // 32 bytes
 
 
-    struct SceneBuffers
+    struct AliasEntry
+    {
+        float probability; // probability of keeping this entry instead of its alias
+        uint32_t alias;
+        float pmf; // normalized weight of this entry, used to evaluate pdfs for MIS
+    }; // 12 bytes
+
+    // Every stream of the scene lives in one sub-allocated buffer, the shader finds them through the header.
+    // Geometry and materials are allocated per mesh and indexed from the heap base, their offsets stay 0.
+    enum class SceneStream : uint32_t
     {
-        renderer::AllocatedBuffer vertexBuffer{};
-        VkDeviceAddress vertexBufferAddress = 0;
-        renderer::AllocatedBuffer triangleBuffer{};
-        VkDeviceAddress triangleBufferAddress = 0;
-        renderer::AllocatedBuffer materialBuffer{};
-        VkDeviceAddress materialBufferAddress = 0;
-        renderer::AllocatedBuffer nodeBuffer{};
-        VkDeviceAddress nodeBufferAddress = 0;
-        renderer::AllocatedBuffer meshInfoBuffer{};
-        VkDeviceAddress meshInfoBufferAddress = 0;
+        Vertices = 0,
+        Triangles,
+        Nodes,
+        Materials,
+        MeshInfos,
+        Lights,
+        Sobol,
+        Count
     };
 
+    // leaves room for new streams without changing the header layout on the shader side
+    constexpr uint32_t MAX_SCENE_STREAMS = 16;
+
+    // Generator matrices of the Sobol sequence, one column per bit for each dimension. Paths draw their dimensions
+    // in groups of SOBOL_DIMENSIONS, every group is decorrelated from the others by its own Owen scrambling.
+    constexpr uint32_t SOBOL_DIMENSIONS = 4;
+    constexpr uint32_t SOBOL_BITS = 32;
+
+    struct SceneHeader
+    {
+        VkDeviceAddress heapAddress = 0;
+        VkDeviceSize streamOffsets[MAX_SCENE_STREAMS] = {}; // byte offsets from heapAddress, indexed by SceneStream
+        uint32_t meshCount = 0;
+        uint32_t lightCount = 0;
+        uint32_t padding[2];
+    }; // 152 bytes
+
+    // lightOffset of meshes without emission
+    constexpr uint32_t NO_LIGHT = 0xFFFFFFFF;
+
     struct MeshInfo
     {
         uint32_t vertexOffset = 0;
         uint32_t triangleOffset = 0;
         uint32_t nodeOffset = 0;
         uint32_t materialIndex = 0;
-    };
+        uint32_t lightOffset = NO_LIGHT; // the triangles of an emissive mesh are consecutive lights from here
+        uint32_t padding[3];
+    }; // 32 bytes
+
+    // Emissive triangle, the alias entry picks it proportionally to area * emission
+    struct LightTriangle
+    {
+        uint32_t triIndex; // heap-relative like the MeshInfo offsets
+        uint32_t vertexOffset;
+        uint32_t materialIndex;
+        float area;
+        float probability;
+        uint32_t alias;
+        float pmf;
+        float padding;
+    }; // 32 bytes
 
     struct PushConstants
     {
-        VkDeviceAddress vertexBuffer;
-        VkDeviceAddress triangleBuffer;
-        VkDeviceAddress nodeBuffer;
-        VkDeviceAddress materialBuffer;
-        VkDeviceAddress meshInfoBuffer;
-        uint32_t meshCount;
+        VkDeviceAddress sceneHeader;
+        VkDeviceAddress envAliasBuffer = 0;
         uint32_t frame;
         uint32_t bounces = 5;
         uint32_t samples = 1;
@@ -207,5 +267,124 @@ namespace path_tracing
         uint32_t smoothShading = 1;
         float envMapIntensity = 0.0;
         uint32_t envMapVisible = 0;
+        uint32_t envSamplingWidth = 0;
+        uint32_t envSamplingHeight = 0;
+        uint32_t envImportanceSampling = 1;
+        VkDeviceAddress wavefront = 0; // WavefrontState, only used by the wavefront kernels
+        uint32_t wavefrontQueue = 0;
+        uint32_t wavefrontSample = 0;
+        VkDeviceAddress workCounter = 0; // next pixel of the persistent threads kernel
+        uint32_t lightSampling = 1; // explicit samples of emissive triangles
+        uint32_t sobolSampling = 1; // Owen-scrambled Sobol dimensions, 0 falls back to hashed random numbers
+        VkDeviceAddress tlas = 0; // top level acceleration structure, only read by the ray query variant
+        VkDeviceAddress adaptive = 0; // AdaptiveState, 0 traces every pixel of every frame
+        uint32_t adaptiveRead = 0; // tile list traced by the megakernel, ADAPTIVE_ALL_TILES after a reset
+        uint32_t adaptiveWrite = 0; // tile list filled by the variance pass for the next frame
+        float adaptiveThreshold = 0.02f; // relative error below which a tile stops being traced
+        uint32_t adaptiveMinFrames = 16; // frames every pixel gets before its variance estimate is trusted
+        uint32_t interleave = 1; // traces one pixel of every interleave x interleave block, see Renderer::draw()
+        uint32_t interleavePhase = 0; // pixel of the block traced this frame
+    }; // 128 bytes, the minimum every device supports
+
+    // Entry points of path_tracing.comp, selected with a specialization constant
+    enum class PathTracingKernel : uint32_t
+    {
+        Megakernel = 0,
+        Generate,
+        Extend,
+        Shade,
+        Connect,
+        Accumulate,
+        Persistent,
+        TileVariance,
+        Fill, // copies the traced pixels of an interleaved frame into the rest of their block
     };
+
+    // Wavefront mode, paths are kept in queues between the passes
+    struct WavefrontPath
+    {
+        glm::vec3 origin;
+        uint32_t pixel;
+        glm::vec3 direction;
+        uint32_t seed; // per pixel scrambling of the sampler
+        glm::vec3 throughput;
+        float lastBsdfPdf;
+        uint32_t depth;
+        uint32_t sampleIndex; // index into the sample sequence of the pixel
+        uint32_t padding[2];
+    }; // 64 bytes
+
+    struct WavefrontHit
+    {
+        float dist;
+        uint32_t triIndex;
+        uint32_t vertexOffset;
+        uint32_t materialIndex;
+        uint32_t lightIndex;
+        uint32_t meshIndex;
+        uint32_t padding[2];
+    }; // 32 bytes
+
+    struct WavefrontShadowRay
+    {
+        glm::vec3 origin;
+        uint32_t pixel;
+        glm::vec3 direction;
+        float tMax;
+        glm::vec3 contribution;
+        float padding1;
+    }; // 48 bytes
+
+    // Doubles as the indirect dispatch arguments of the queue, the shader bumps x for every workgroup worth of entries
+    struct WavefrontQueueCounter
+    {
+        VkDispatchIndirectCommand dispatch = {0, 1, 1};
+        uint32_t count = 0;
+    }; // 16 bytes
+
+    // two path queues used in turns per bounce, then the shadow ray queue
+    constexpr uint32_t WAVEFRONT_QUEUE_COUNT = 3;
+    constexpr uint32_t WAVEFRONT_SHADOW_QUEUE = 2;
+
+    struct WavefrontState
+    {
+        VkDeviceAddress counters; // WavefrontQueueCounter[WAVEFRONT_QUEUE_COUNT]
+        VkDeviceAddress pathQueues[2];
+        VkDeviceAddress hits; // indexed like the path queue that was extended
+        VkDeviceAddress shadowQueue;
+        VkDeviceAddress radiance; // vec4 per pixel, summed over the samples of a frame
+    }; // 48 bytes
+
+    // Adaptive sampling works on the 16x16 tiles of the megakernel's workgroups
+    constexpr uint32_t ADAPTIVE_TILE_SIZE = 16;
+    constexpr uint32_t ADAPTIVE_ALL_TILES = 0xFFFFFFFF;
+
+    // Indirect dispatch arguments with one workgroup per tile, the tile indices follow
+    struct AdaptiveTileList
+    {
+        VkDispatchIndirectCommand dispatch = {0, 1, 1};
+        uint32_t padding = 0;
+    }; // 16 bytes
+
+    struct AdaptiveState
+    {
+        VkDeviceAddress moments; // float per pixel, running mean of the squared luminance
+        VkDeviceAddress tileLists[2]; // AdaptiveTileList, traced and refilled in turns
+    }; // 24 bytes
+
+    // Specialization constants of path_tracing.comp in constant_id order, SPEC_DYNAMIC reads the push constant
+    constexpr int32_t SPEC_DYNAMIC = -1;
+    struct ShaderVariant
+    {
+        int32_t bounces = SPEC_DYNAMIC;
+        int32_t smoothShading = SPEC_DYNAMIC;
+        int32_t envMapVisible = SPEC_DYNAMIC;
+        VkBool32 normalMaps = VK_TRUE;
+        VkBool32 brdfDebugging = VK_FALSE;
+        PathTracingKernel kernel = PathTracingKernel::Megakernel;
+        // picks path_tracing_ray_query.comp.spv, not a specialization constant since it needs the RayQuery capability
+        VkBool32 rayQuery = VK_FALSE;
+
+        auto operator<=>(const ShaderVariant&) const = default;
+    }; // 28 bytes
 }
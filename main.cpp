@@ -1,15 +1,31 @@
 #include <iostream>
-#include "Engine.h"
+#include "engine.h"
+#include "distributed.h"
 
-int main()
+int main(int argc, char** argv)
 {
     engine::Engine engine{};
 
     try
     {
-        engine.init();
-        engine.run();
-        engine.cleanup();
+        const engine::LaunchSettings launch = engine::parseCommandLine(argc, argv);
+        switch (launch.mode)
+        {
+        case engine::LaunchSettings::Mode::Offline:
+            engine.renderOffline(launch.jobs);
+            break;
+        case engine::LaunchSettings::Mode::Coordinator:
+            engine::coordinateRender(launch.jobs, launch.distributed);
+            break;
+        case engine::LaunchSettings::Mode::Worker:
+            engine.runWorker(launch.coordinatorHost, launch.distributed.port);
+            break;
+        default:
+            engine.init();
+            engine.run();
+            engine.cleanup();
+            break;
+        }
     }
     catch (const std::exception& e)
     {
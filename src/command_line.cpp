@@ -0,0 +1,291 @@
+#include "command_line.h"
+
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace engine
+{
+    namespace
+    {
+        constexpr const char* USAGE =
+            "Usage: vkPathTracer [--headless [--batch jobs.txt] [options]]\n"
+            "       vkPathTracer --headless --coordinator [--port 7311] [--tile pixels] [--unit-spp samples]\n"
+            "                    [--batch jobs.txt] [options]\n"
+            "       vkPathTracer --headless --worker host:port\n"
+            "Options: --scene a.obj,b.obj  --env sky.hdr  --position x,y,z  --direction x,y,z  --fov degrees\n"
+            "         --width pixels  --height pixels  --spp samples  --bounces count\n"
+            "         --material mesh:color=r,g,b|emission=e|roughness=r|metallic=m  --output image.png|.exr|.pfm";
+
+        [[noreturn]] void invalidArguments(const std::string& message)
+        {
+            throw std::runtime_error(std::format("{}\n{}", message, USAGE));
+        }
+
+        std::vector<std::string> split(const std::string& value, char separator)
+        {
+            std::vector<std::string> parts;
+            std::stringstream stream(value);
+            for (std::string part; std::getline(stream, part, separator);)
+                parts.push_back(part);
+            return parts;
+        }
+
+        float parseFloat(const std::string& option, const std::string& value)
+        {
+            size_t parsed = 0;
+            float result = 0.0f;
+            try
+            {
+                result = std::stof(value, &parsed);
+            }
+            catch (const std::exception&)
+            {
+                parsed = 0;
+            }
+            if (parsed == 0 || parsed != value.size())
+                invalidArguments(std::format("Invalid value '{}' for {}", value, option));
+            return result;
+        }
+
+        uint32_t parseUint(const std::string& option, const std::string& value, uint32_t minimum = 1)
+        {
+            // parsed as an integer, a float would round everything above 2^24
+            uint64_t number = 0;
+            const char* end = value.data() + value.size();
+            const auto [last, error] = std::from_chars(value.data(), end, number);
+            if (error != std::errc() || last != end || number < minimum ||
+                number > std::numeric_limits<uint32_t>::max())
+                invalidArguments(std::format("{} needs an integer of at least {}, got '{}'", option, minimum, value));
+            return static_cast<uint32_t>(number);
+        }
+
+        uint16_t parsePort(const std::string& option, const std::string& value)
+        {
+            const uint32_t port = parseUint(option, value);
+            if (port > 65535)
+                invalidArguments(std::format("{} is not a port", value));
+            return static_cast<uint16_t>(port);
+        }
+
+        glm::vec3 parseVec3(const std::string& option, const std::string& value)
+        {
+            const std::vector<std::string> parts = split(value, ',');
+            if (parts.size() != 3)
+                invalidArguments(std::format("{} needs three comma separated numbers, got '{}'", option, value));
+            return {parseFloat(option, parts[0]), parseFloat(option, parts[1]), parseFloat(option, parts[2])};
+        }
+
+        // mesh:property=value, several properties of one mesh are merged into a single override
+        void parseMaterialOverride(const std::string& option, const std::string& value,
+                                   std::vector<MaterialOverride>& overrides)
+        {
+            const size_t colon = value.find(':');
+            const size_t equals = value.find('=');
+            if (colon == std::string::npos || equals == std::string::npos || equals < colon)
+                invalidArguments(std::format("{} needs mesh:property=value, got '{}'", option, value));
+            const uint32_t mesh = parseUint(option, value.substr(0, colon), 0);
+            const std::string property = value.substr(colon + 1, equals - colon - 1);
+            const std::string argument = value.substr(equals + 1);
+
+            auto it = std::ranges::find(overrides, mesh, &MaterialOverride::mesh);
+            if (it == overrides.end())
+                it = overrides.insert(overrides.end(), {.mesh = mesh});
+            if (property == "color")
+                it->color = parseVec3(option, argument);
+            else if (property == "emission")
+                it->emissiveStrength = parseFloat(option, argument);
+            else if (property == "roughness")
+                it->roughness = parseFloat(option, argument);
+            else if (property == "metallic")
+                it->metallic = parseFloat(option, argument);
+            else
+                invalidArguments(std::format("Unknown material property '{}'", property));
+        }
+
+        // Applies the option value pairs on top of the settings
+        void parseOptions(const std::vector<std::string>& arguments, OfflineRenderSettings& settings)
+        {
+            for (size_t i = 0; i < arguments.size(); i++)
+            {
+                const std::string& option = arguments[i];
+                if (i + 1 >= arguments.size())
+                    invalidArguments(std::format("Missing value for {}", option));
+                const std::string& value = arguments[++i];
+
+                if (option == "--scene")
+                {
+                    settings.scene.models.clear();
+                    for (const std::string& model : split(value, ','))
+                        settings.scene.models.emplace_back(model);
+                }
+                else if (option == "--env")
+                    settings.scene.envMap = value;
+                else if (option == "--material")
+                    parseMaterialOverride(option, value, settings.materials);
+                else if (option == "--position")
+                    settings.cameraPosition = parseVec3(option, value);
+                else if (option == "--direction")
+                    settings.cameraDirection = parseVec3(option, value);
+                else if (option == "--fov")
+                    settings.fov = parseFloat(option, value);
+                else if (option == "--width")
+                    settings.width = parseUint(option, value);
+                else if (option == "--height")
+                    settings.height = parseUint(option, value);
+                else if (option == "--spp")
+                    settings.samples = parseUint(option, value);
+                else if (option == "--bounces")
+                    settings.bounces = parseUint(option, value, 0);
+                else if (option == "--output")
+                    settings.output = value;
+                else
+                    invalidArguments(std::format("Unknown option {}", option));
+            }
+        }
+
+        void validate(const OfflineRenderSettings& settings)
+        {
+            if (settings.scene.models.empty())
+                invalidArguments("No models to render");
+            if (settings.scene.envMap.empty())
+                invalidArguments("No environment map, the path tracer needs one");
+            if (glm::dot(settings.cameraDirection, settings.cameraDirection) == 0.0f)
+                invalidArguments("The camera direction has no length");
+            if (settings.fov <= 0.0f || settings.fov >= 180.0f)
+                invalidArguments("The field of view is out of (0, 180) degrees");
+            const std::string extension = std::filesystem::path(settings.output).extension().string();
+            if (extension != ".png" && extension != ".exr" && extension != ".pfm")
+                invalidArguments(std::format("Unsupported output format '{}'", extension));
+        }
+    }
+
+    void MaterialOverride::apply(path_tracing::Material& material) const
+    {
+        if (color.has_value())
+            material.color = color.value();
+        if (emissiveStrength.has_value())
+            material.emissiveStrength = emissiveStrength.value();
+        if (roughness.has_value())
+            material.roughness = roughness.value();
+        if (metallic.has_value())
+            material.metallic = metallic.value();
+    }
+
+    LaunchSettings parseCommandLine(int argc, char** argv)
+    {
+        LaunchSettings launch;
+        if (argc <= 1)
+            return launch;
+
+        bool headless = false;
+        std::optional<std::string> batch;
+        std::optional<std::string> worker;
+        std::vector<std::string> arguments;
+        launch.mode = LaunchSettings::Mode::Offline;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (argument == "--headless")
+                headless = true;
+            else if (argument == "--coordinator")
+                launch.mode = LaunchSettings::Mode::Coordinator;
+            else if (argument == "--worker" && hasValue)
+                worker = argv[++i];
+            else if (argument == "--batch" && hasValue)
+                batch = argv[++i];
+            else if (argument == "--port" && hasValue)
+                launch.distributed.port = parsePort(argument, argv[++i]);
+            else if (argument == "--tile" && hasValue)
+                launch.distributed.tileSize = parseUint(argument, argv[++i]);
+            else if (argument == "--unit-spp" && hasValue)
+                launch.distributed.unitSamples = parseUint(argument, argv[++i], 0);
+            else
+                arguments.push_back(argument);
+        }
+        if (!headless)
+            invalidArguments("The render options need --headless");
+
+        if (worker.has_value())
+        {
+            // the coordinator sends the jobs
+            const size_t colon = worker->rfind(':');
+            if (colon == std::string::npos || !arguments.empty() || launch.mode == LaunchSettings::Mode::Coordinator)
+                invalidArguments("A worker only takes the host:port of its coordinator");
+            launch.mode = LaunchSettings::Mode::Worker;
+            launch.coordinatorHost = worker->substr(0, colon);
+            launch.distributed.port = parsePort("--worker", worker->substr(colon + 1));
+            return launch;
+        }
+
+        OfflineRenderSettings settings;
+        parseOptions(arguments, settings);
+        if (batch.has_value())
+            launch.jobs = parseJobFile(batch.value(), settings);
+        else
+        {
+            validate(settings);
+            launch.jobs = {settings};
+        }
+
+        // the coordinator has no device to tone map with
+        if (launch.mode == LaunchSettings::Mode::Coordinator)
+        {
+            for (const OfflineRenderSettings& job : launch.jobs)
+            {
+                if (std::filesystem::path(job.output).extension() == ".png")
+                    invalidArguments("Distributed renders write the linear radiance, to .exr or .pfm");
+            }
+        }
+        return launch;
+    }
+
+    std::vector<OfflineRenderSettings> parseJobFile(const std::string& path, const OfflineRenderSettings& defaults)
+    {
+        std::ifstream file(path);
+        if (!file)
+            throw std::runtime_error(std::format("Could not open the job file {}!", path));
+
+        std::vector<OfflineRenderSettings> jobs;
+        OfflineRenderSettings previous = defaults;
+        uint32_t lineNumber = 0;
+        for (std::string line; std::getline(file, line);)
+        {
+            lineNumber++;
+            line = line.substr(0, line.find('#'));
+            // quoted values may contain spaces
+            std::istringstream stream(line);
+            std::vector<std::string> arguments;
+            for (std::string argument; stream >> std::quoted(argument);)
+                arguments.push_back(argument);
+            if (arguments.empty())
+                continue;
+
+            OfflineRenderSettings job = previous;
+            job.materials = defaults.materials;
+            try
+            {
+                parseOptions(arguments, job);
+                validate(job);
+                if (!jobs.empty() && (job.width != jobs.front().width || job.height != jobs.front().height))
+                    invalidArguments("All jobs of a batch share the resolution of the first one");
+            }
+            catch (const std::runtime_error& e)
+            {
+                throw std::runtime_error(std::format("{}:{}: {}", path, lineNumber, e.what()));
+            }
+            jobs.push_back(job);
+            previous = job;
+        }
+        if (jobs.empty())
+            throw std::runtime_error(std::format("The job file {} has no jobs!", path));
+        return jobs;
+    }
+} // engine
@@ -0,0 +1,80 @@
+#pragma once
+#include "constants.h"
+#include "types.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "path_tracing/scene.h"
+
+namespace engine
+{
+    // Opened by the viewer, and rendered offline when the command line names no scene
+    inline const path_tracing::SceneDescription DEFAULT_SCENE = {
+        .models = {"./assets/models/halo_armor/halo_armor.obj", "./assets/models/top_light/top_light.obj"},
+        .envMap = "./assets/skyboxes/dikhololo_night_2k.hdr",
+    };
+
+    // Replaces material parameters of one mesh of an offline render, the others keep the ones of the model
+    struct MaterialOverride
+    {
+        uint32_t mesh = 0; // index into the meshes of all models, in the order they are listed
+        std::optional<glm::vec3> color;
+        std::optional<float> emissiveStrength;
+        std::optional<float> roughness;
+        std::optional<float> metallic;
+
+        void apply(path_tracing::Material& material) const;
+    };
+
+    // A single image rendered without a window, for render nodes and software Vulkan implementations
+    struct OfflineRenderSettings
+    {
+        path_tracing::SceneDescription scene = DEFAULT_SCENE;
+        std::vector<MaterialOverride> materials;
+        glm::vec3 cameraPosition = {0.0f, 0.0f, 1.8f};
+        glm::vec3 cameraDirection = {0.0f, 0.0f, -1.0f};
+        float fov = 35.0f;
+        uint32_t width = WIDTH;
+        uint32_t height = HEIGHT;
+        uint32_t samples = 256; // per pixel, one per accumulated frame
+        uint32_t bounces = 5;
+        // .png is tone mapped like the viewer, .exr and .pfm hold the linear radiance
+        std::string output = "render.png";
+    };
+
+    // Splitting of the jobs between the worker processes of a distributed render
+    struct DistributedSettings
+    {
+        uint16_t port = 7311;
+        uint32_t tileSize = 256; // square tiles, also the draw image size of the workers
+        uint32_t unitSamples = 0; // samples of a tile per work unit, 0 renders every tile in a single unit
+    };
+
+    // What the process does, picked from the command line
+    struct LaunchSettings
+    {
+        enum class Mode
+        {
+            Viewer,
+            Offline, // renders the jobs itself
+            Coordinator, // hands the jobs out to the workers connecting to it and merges their results
+            Worker, // renders the work units of a coordinator
+        };
+
+        Mode mode = Mode::Viewer;
+        std::vector<OfflineRenderSettings> jobs; // offline and coordinator only
+        DistributedSettings distributed;
+        std::string coordinatorHost; // worker only, the port is distributed.port
+    };
+
+    // Anything but the viewer needs --headless. Without --batch the command line describes a single job, with it
+    // the options are the defaults of the jobs in the file. Throws on malformed arguments.
+    LaunchSettings parseCommandLine(int argc, char** argv);
+    // One job per line, each one the options of the command line on top of the job before it. Material overrides
+    // only apply to the line naming them, # starts a comment. All jobs share the resolution of the first one.
+    std::vector<OfflineRenderSettings> parseJobFile(const std::string& path, const OfflineRenderSettings& defaults);
+} // engine
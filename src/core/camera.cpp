@@ -1,4 +1,4 @@
-#include "Camera.h"
+#include "camera.h"
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
@@ -0,0 +1,51 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+    // Splits [0, count) into contiguous chunks, one per hardware thread, and calls func(begin, end) on each. An
+    // exception thrown by a chunk is rethrown once every chunk is done, the first chunk's one if several threw.
+    template <typename Func>
+    void parallelFor(uint32_t count, Func&& func)
+    {
+        const uint32_t threadCount = std::clamp(std::thread::hardware_concurrency(), 1u, std::max(count, 1u));
+        if (threadCount <= 1)
+        {
+            func(0u, count);
+            return;
+        }
+
+        const uint32_t chunkSize = (count + threadCount - 1) / threadCount;
+        std::vector<std::thread> workers;
+        std::vector<std::exception_ptr> errors(threadCount);
+        workers.reserve(threadCount);
+        for (uint32_t begin = 0; begin < count; begin += chunkSize)
+        {
+            const uint32_t end = std::min(begin + chunkSize, count);
+            std::exception_ptr& error = errors[workers.size()];
+            workers.emplace_back([&func, &error, begin, end]()
+            {
+                // an exception leaving a std::thread terminates the process
+                try
+                {
+                    func(begin, end);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+            });
+        }
+        for (auto& worker : workers)
+            worker.join();
+        for (const auto& error : errors)
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+} // core
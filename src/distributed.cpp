@@ -0,0 +1,300 @@
+#include "distributed.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "renderer/image_writer.h"
+
+namespace engine
+{
+    namespace
+    {
+        constexpr uint32_t COLOR_OVERRIDE = 1 << 0;
+        constexpr uint32_t EMISSION_OVERRIDE = 1 << 1;
+        constexpr uint32_t ROUGHNESS_OVERRIDE = 1 << 2;
+        constexpr uint32_t METALLIC_OVERRIDE = 1 << 3;
+
+        void writeOutput(const OfflineRenderSettings& job, const JobAccumulation& accumulation)
+        {
+            const std::vector<float> rgb = resolveAccumulation(accumulation);
+            if (std::filesystem::path(job.output).extension() == ".exr")
+                renderer::writeExr(job.output, rgb.data(), job.width, job.height);
+            else
+                renderer::PfmWriter(job.output, job.width, job.height).writeStrip(rgb.data(), job.height);
+        }
+    }
+
+    void mergeTile(JobAccumulation& accumulation, const OfflineRenderSettings& job, const WorkUnit& unit,
+                   uint32_t tileSize, const std::vector<float>& texels)
+    {
+        if (accumulation.samples.empty())
+        {
+            const size_t pixelCount = static_cast<size_t>(job.width) * job.height;
+            accumulation.radiance.resize(pixelCount * 3);
+            accumulation.samples.resize(pixelCount);
+        }
+        const uint32_t width = std::min(tileSize, job.width - unit.originX);
+        const uint32_t height = std::min(tileSize, job.height - unit.originY);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                const float* texel = &texels[(static_cast<size_t>(y) * tileSize + x) * 4];
+                const size_t pixel = static_cast<size_t>(unit.originY + y) * job.width + unit.originX + x;
+                for (uint32_t c = 0; c < 3; c++)
+                    accumulation.radiance[pixel * 3 + c] += texel[c] * texel[3];
+                accumulation.samples[pixel] += texel[3];
+            }
+        }
+    }
+
+    std::vector<float> resolveAccumulation(const JobAccumulation& accumulation)
+    {
+        std::vector<float> rgb(accumulation.radiance.size());
+        for (size_t i = 0; i < accumulation.samples.size(); i++)
+        {
+            const float samples = accumulation.samples[i];
+            for (uint32_t c = 0; c < 3; c++)
+                rgb[i * 3 + c] = samples > 0.0f ? accumulation.radiance[i * 3 + c] / samples : 0.0f;
+        }
+        return rgb;
+    }
+
+    void writeJob(network::MessageWriter& writer, const OfflineRenderSettings& job)
+    {
+        writer.write(static_cast<uint32_t>(job.scene.models.size()));
+        for (const auto& model : job.scene.models)
+            writer.write(model.string());
+        writer.write(job.scene.envMap);
+
+        writer.write(static_cast<uint32_t>(job.materials.size()));
+        for (const MaterialOverride& material : job.materials)
+        {
+            const uint32_t flags = (material.color.has_value() ? COLOR_OVERRIDE : 0) |
+                (material.emissiveStrength.has_value() ? EMISSION_OVERRIDE : 0) |
+                (material.roughness.has_value() ? ROUGHNESS_OVERRIDE : 0) |
+                (material.metallic.has_value() ? METALLIC_OVERRIDE : 0);
+            writer.write(material.mesh).write(flags);
+            writer.write(material.color.value_or(glm::vec3(0.0f)));
+            writer.write(material.emissiveStrength.value_or(0.0f));
+            writer.write(material.roughness.value_or(0.0f));
+            writer.write(material.metallic.value_or(0.0f));
+        }
+
+        writer.write(job.cameraPosition).write(job.cameraDirection).write(job.fov);
+        writer.write(job.width).write(job.height).write(job.samples).write(job.bounces);
+        writer.write(job.output);
+    }
+
+    OfflineRenderSettings readJob(network::MessageReader& reader)
+    {
+        OfflineRenderSettings job;
+        job.scene.models.resize(reader.read<uint32_t>());
+        for (auto& model : job.scene.models)
+            model = reader.readString();
+        job.scene.envMap = reader.readString();
+
+        job.materials.resize(reader.read<uint32_t>());
+        for (MaterialOverride& material : job.materials)
+        {
+            material.mesh = reader.read<uint32_t>();
+            const auto flags = reader.read<uint32_t>();
+            const auto color = reader.read<glm::vec3>();
+            const auto emissiveStrength = reader.read<float>();
+            const auto roughness = reader.read<float>();
+            const auto metallic = reader.read<float>();
+            if (flags & COLOR_OVERRIDE)
+                material.color = color;
+            if (flags & EMISSION_OVERRIDE)
+                material.emissiveStrength = emissiveStrength;
+            if (flags & ROUGHNESS_OVERRIDE)
+                material.roughness = roughness;
+            if (flags & METALLIC_OVERRIDE)
+                material.metallic = metallic;
+        }
+
+        job.cameraPosition = reader.read<glm::vec3>();
+        job.cameraDirection = reader.read<glm::vec3>();
+        job.fov = reader.read<float>();
+        job.width = reader.read<uint32_t>();
+        job.height = reader.read<uint32_t>();
+        job.samples = reader.read<uint32_t>();
+        job.bounces = reader.read<uint32_t>();
+        job.output = reader.readString();
+        return job;
+    }
+
+    void coordinateRender(const std::vector<OfflineRenderSettings>& jobs, const DistributedSettings& settings)
+    {
+        const uint32_t tileSize = std::max(settings.tileSize, 1u);
+        std::deque<WorkUnit> queue;
+        std::vector<JobAccumulation> accumulations(jobs.size());
+        for (uint32_t jobIndex = 0; jobIndex < jobs.size(); jobIndex++)
+        {
+            const OfflineRenderSettings& job = jobs[jobIndex];
+            const uint32_t unitSamples = settings.unitSamples == 0
+                                             ? job.samples
+                                             : std::min(settings.unitSamples, job.samples);
+            // the sample ranges of a tile go to different workers, each continues the sequence where the last ends
+            for (uint32_t y = 0; y < job.height; y += tileSize)
+            {
+                for (uint32_t x = 0; x < job.width; x += tileSize)
+                {
+                    for (uint32_t offset = 0; offset < job.samples; offset += unitSamples)
+                    {
+                        queue.push_back({
+                            .id = static_cast<uint32_t>(queue.size()), .job = jobIndex, .originX = x, .originY = y,
+                            .sampleOffset = offset, .samples = std::min(unitSamples, job.samples - offset)
+                        });
+                        accumulations[jobIndex].unitsLeft++;
+                    }
+                }
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        size_t unitsLeft = queue.size();
+        std::vector<uint32_t> failedAttempts(queue.size());
+        std::optional<std::string> failure;
+
+        // called with the mutex held
+        auto merge = [&](const WorkUnit& unit, const std::vector<float>& texels)
+        {
+            const OfflineRenderSettings& job = jobs[unit.job];
+            JobAccumulation& accumulation = accumulations[unit.job];
+            mergeTile(accumulation, job, unit, tileSize, texels);
+
+            unitsLeft--;
+            if (--accumulation.unitsLeft == 0)
+            {
+                // the unit is merged either way, a failed write must not send it to another worker
+                try
+                {
+                    writeOutput(job, accumulation);
+                    std::cout << std::format("{} ({}/{}) merged", job.output, unit.job + 1, jobs.size()) << std::endl;
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << e.what() << std::endl;
+                }
+                accumulation = {};
+            }
+        };
+
+        // Called with the mutex held. A unit that failed or lost its worker MAX_UNIT_ATTEMPTS times fails the render,
+        // a broken job would otherwise be retried forever.
+        auto retry = [&](const WorkUnit& unit, const std::string& error)
+        {
+            if (++failedAttempts[unit.id] >= MAX_UNIT_ATTEMPTS)
+                failure = std::format("Unit {} of {} failed {} times: {}", unit.id, jobs[unit.job].output,
+                                      MAX_UNIT_ATTEMPTS, error);
+            else
+                queue.push_back(unit);
+        };
+
+        auto serve = [&](network::Socket socket)
+        {
+            try
+            {
+                network::MessageReader hello(socket.receive());
+                if (hello.read<DistributedMessage>() != DistributedMessage::Hello ||
+                    hello.read<uint32_t>() != DISTRIBUTED_PROTOCOL_VERSION)
+                    throw std::runtime_error("The worker speaks another protocol version!");
+
+                std::optional<uint32_t> sentJob;
+                while (true)
+                {
+                    WorkUnit unit;
+                    {
+                        std::unique_lock lock(mutex);
+                        changed.wait(lock, [&]() { return !queue.empty() || unitsLeft == 0 || failure.has_value(); });
+                        if (unitsLeft == 0 || failure.has_value())
+                            break;
+                        unit = queue.front();
+                        queue.pop_front();
+                    }
+
+                    try
+                    {
+                        if (sentJob != unit.job)
+                        {
+                            network::MessageWriter job;
+                            job.write(DistributedMessage::Job).write(unit.job).write(tileSize);
+                            writeJob(job, jobs[unit.job]);
+                            socket.send(job.data());
+                            sentJob = unit.job;
+                        }
+                        socket.send(network::MessageWriter().write(DistributedMessage::Unit).write(unit).data());
+
+                        network::MessageReader result(socket.receive());
+                        const auto type = result.read<DistributedMessage>();
+                        if ((type != DistributedMessage::Result && type != DistributedMessage::Failed) ||
+                            result.read<uint32_t>() != unit.id)
+                            throw std::runtime_error("The worker answered with another unit!");
+                        if (type == DistributedMessage::Failed)
+                        {
+                            // the worker stays, the unit goes to the end of the queue
+                            const std::string error = result.readString();
+                            std::cerr << std::format("Unit {} failed: {}", unit.id, error) << std::endl;
+                            {
+                                std::lock_guard lock(mutex);
+                                retry(unit, error);
+                            }
+                            changed.notify_all();
+                            continue;
+                        }
+                        const std::vector<float> texels = result.readVector<float>();
+                        if (texels.size() != static_cast<size_t>(tileSize) * tileSize * 4)
+                            throw std::runtime_error("The worker returned a tile of another size!");
+
+                        std::lock_guard lock(mutex);
+                        merge(unit, texels);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        // another worker picks the unit up
+                        {
+                            std::lock_guard lock(mutex);
+                            retry(unit, e.what());
+                        }
+                        changed.notify_all();
+                        throw;
+                    }
+                    changed.notify_all();
+                }
+                socket.send(network::MessageWriter().write(DistributedMessage::Done).data());
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "Worker dropped: " << e.what() << std::endl;
+            }
+        };
+
+        network::Listener listener(settings.port);
+        std::cout << std::format("Waiting for workers on port {}, {} work units", settings.port, unitsLeft)
+            << std::endl;
+        std::vector<std::thread> workers;
+        while (true)
+        {
+            {
+                std::lock_guard lock(mutex);
+                if (unitsLeft == 0 || failure.has_value())
+                    break;
+            }
+            if (std::optional<network::Socket> socket = listener.accept(std::chrono::milliseconds(200)))
+                workers.emplace_back(serve, std::move(socket.value()));
+        }
+        for (auto& worker : workers)
+            worker.join();
+        if (failure.has_value())
+            throw std::runtime_error(failure.value());
+    }
+} // engine
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "command_line.h"
+#include "network/socket.h"
+
+namespace engine
+{
+    constexpr uint32_t DISTRIBUTED_PROTOCOL_VERSION = 2;
+    // a unit failing or losing its worker this many times fails the render
+    constexpr uint32_t MAX_UNIT_ATTEMPTS = 3;
+
+    // Messages between the coordinator and its workers, each one starts with its type
+    enum class DistributedMessage : uint32_t
+    {
+        Hello = 0, // worker to coordinator, the protocol version
+        Job, // coordinator to worker, the job index, the tile size and the job settings
+        Unit, // coordinator to worker, a WorkUnit of the last job
+        Result, // worker to coordinator, the unit id and the rgba floats of its tile, the sample count in alpha
+        Done, // coordinator to worker, nothing left to render
+        Failed, // worker to coordinator, the unit id and the error, instead of its Result
+    };
+
+    // One tile of a job, or a range of its samples
+    struct WorkUnit
+    {
+        uint32_t id = 0;
+        uint32_t job = 0;
+        uint32_t originX = 0;
+        uint32_t originY = 0;
+        uint32_t sampleOffset = 0;
+        uint32_t samples = 0;
+    };
+
+    // Radiance of one job summed over the units, weighted by their sample counts
+    struct JobAccumulation
+    {
+        std::vector<float> radiance; // rgb
+        std::vector<float> samples;
+        uint32_t unitsLeft = 0;
+    };
+
+    // Adds the rgba tile of a unit weighted by the sample count in its alpha, the texels past the image are dropped.
+    // Allocates the accumulation with the first unit of the job.
+    void mergeTile(JobAccumulation& accumulation, const OfflineRenderSettings& job, const WorkUnit& unit,
+                   uint32_t tileSize, const std::vector<float>& texels);
+    // Average rgb radiance of every pixel, black where no sample landed
+    std::vector<float> resolveAccumulation(const JobAccumulation& accumulation);
+
+    void writeJob(network::MessageWriter& writer, const OfflineRenderSettings& job);
+    OfflineRenderSettings readJob(network::MessageReader& reader);
+
+    // Splits the jobs into work units and hands them to the workers connecting to the port, merging the returned
+    // accumulations weighted by their sample counts. Needs no device itself. Units of a lost worker go to another
+    // one, workers may join at any time until everything is merged. Throws once a unit failed MAX_UNIT_ATTEMPTS
+    // times.
+    void coordinateRender(const std::vector<OfflineRenderSettings>& jobs, const DistributedSettings& settings);
+} // engine
@@ -1,5 +1,14 @@
 #include "engine.h"
 
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <set>
+
+#include "distributed.h"
+#include "renderer/image_writer.h"
+
 
 namespace engine
 {
@@ -7,21 +16,224 @@ namespace engine
     {
         initWindow();
         initImGui();
+
+        // the assets are parsed while the renderer compiles its pipelines
+        loadSceneAsync(DEFAULT_SCENE);
         renderer_.init(window_);
         camera_.position = glm::vec3(0.0, 0.0, 1.8);
 
-        auto halo = path_tracing::loadFromObj("./assets/models/halo_armor/halo_armor.obj");
-        // auto sphere = path_tracing::loadFromObj("./assets/models/sphere.obj");
-        // sphere[0].material.color = glm::vec3(1.0, 1.0, 1.0);
-        // sphere[0].material.metallic = 0.0;
-        // sphere[0].material.roughness = 0.0;
-        auto light = path_tracing::loadFromObj("./assets/models/top_light/top_light.obj");
+        // the first scene is waited for, later ones are swapped in without stalling the frames
+        renderer_.stageScene(sceneLoad_.get());
+    }
+
+    void Engine::initOffline(VkExtent2D extent)
+    {
+        renderer_.initHeadless(extent);
+        // one sample per pixel and frame, every pixel traced in every frame
+        renderer_.ptPushConstants_.samples = 1;
+        renderer_.timeBudget_ = false;
+        renderer_.dynamicResolution_ = false;
+    }
+
+    void Engine::prepareOfflineJob(const OfflineRenderSettings& job)
+    {
+        OfflineScene& offline = offlineScene_;
+        auto overriddenMaterial = [&](uint32_t mesh)
+        {
+            path_tracing::Material material = offline.baseMaterials[mesh];
+            for (const MaterialOverride& materialOverride : job.materials)
+            {
+                if (materialOverride.mesh == mesh)
+                    materialOverride.apply(material);
+            }
+            return material;
+        };
+
+        std::set<uint32_t> changedMeshes = offline.overriddenMeshes;
+        offline.overriddenMeshes.clear();
+        for (const MaterialOverride& materialOverride : job.materials)
+            offline.overriddenMeshes.insert(materialOverride.mesh);
+        changedMeshes.insert(offline.overriddenMeshes.begin(), offline.overriddenMeshes.end());
+
+        if (offline.models != job.scene.models)
+        {
+            path_tracing::SceneData scene = offline.cache.load(job.scene.models, [this](const std::string& path)
+            {
+                return renderer_.hasTexture(path);
+            });
+            offline.baseMaterials.clear();
+            for (const auto& mesh : scene.meshes)
+                offline.baseMaterials.push_back(mesh.material);
+            changedMeshes = offline.overriddenMeshes;
+            for (uint32_t mesh : changedMeshes)
+            {
+                if (mesh < offline.baseMaterials.size())
+                    scene.meshes[mesh].material = overriddenMaterial(mesh);
+            }
+            offline.meshes = renderer_.stageScene(scene);
+            offline.models = job.scene.models;
+        }
+        else
+        {
+            // the overrides of the previous job are undone, everything else stays as it is
+            for (uint32_t mesh : changedMeshes)
+            {
+                if (mesh < offline.baseMaterials.size())
+                    renderer_.updateMaterial(offline.meshes[mesh], overriddenMaterial(mesh));
+            }
+        }
+        if (!offline.overriddenMeshes.empty() && *offline.overriddenMeshes.rbegin() >= offline.baseMaterials.size())
+        {
+            throw std::runtime_error(std::format("{}: material override of mesh {}, the scene has {} meshes",
+                                                 job.output, *offline.overriddenMeshes.rbegin(),
+                                                 offline.baseMaterials.size()));
+        }
+        renderer_.useResidentEnvironment(job.scene.envMap);
+        renderer_.ptPushConstants_.bounces = job.bounces;
+
+        camera_ = core::Camera(job.fov, static_cast<float>(job.width) / static_cast<float>(job.height));
+        camera_.position = job.cameraPosition;
+        camera_.direction = glm::normalize(job.cameraDirection);
+        camera_.updateMatrix();
+        renderer_.resetAccumulation();
+    }
+
+    void Engine::renderOffline(const std::vector<OfflineRenderSettings>& jobs)
+    {
+        initOffline({jobs.front().width, jobs.front().height});
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            const OfflineRenderSettings& job = jobs[i];
+            const auto start = std::chrono::steady_clock::now();
+            prepareOfflineJob(job);
+
+            // the accumulation restarts once a staged scene is swapped in
+            while (renderer_.hasStagedScene() || renderer_.accumulatedFrames() < job.samples)
+                renderer_.render(camera_);
+            writeOfflineOutput(job.output);
+
+            const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+            std::cout << std::format("{} ({}/{}) rendered in {:.2f} s", job.output, i + 1, jobs.size(),
+                                     duration.count()) << std::endl;
+        }
+        renderer_.cleanup();
+    }
+
+    void Engine::runWorker(const std::string& host, uint16_t port)
+    {
+        network::Socket socket = network::Socket::connect(host, port);
+        network::MessageWriter hello;
+        hello.write(DistributedMessage::Hello).write(DISTRIBUTED_PROTOCOL_VERSION);
+        socket.send(hello.data());
+        std::cout << std::format("Connected to {}:{}", host, port) << std::endl;
+
+        bool initialized = false;
+        OfflineRenderSettings job;
+        // the units of a job that could not be prepared are answered with its error
+        std::optional<std::string> jobError;
+        while (true)
+        {
+            network::MessageReader message(socket.receive());
+            const auto type = message.read<DistributedMessage>();
+            if (type == DistributedMessage::Done)
+                break;
+
+            if (type == DistributedMessage::Job)
+            {
+                const auto index = message.read<uint32_t>();
+                const auto tileSize = message.read<uint32_t>();
+                job = readJob(message);
+                // the draw image only has to hold a tile, every job of a render has the same tile size
+                if (!initialized)
+                    initOffline({tileSize, tileSize});
+                initialized = true;
+                jobError.reset();
+                try
+                {
+                    prepareOfflineJob(job);
+                    // uploads the scene before the first unit
+                    do
+                        renderer_.render(camera_);
+                    while (renderer_.hasStagedScene());
+                    std::cout << std::format("Job {}: {}", index + 1, job.output) << std::endl;
+                }
+                catch (const std::exception& e)
+                {
+                    jobError = e.what();
+                    std::cerr << std::format("Job {}: {}", index + 1, e.what()) << std::endl;
+                }
+            }
+            else if (type == DistributedMessage::Unit && initialized)
+            {
+                const auto unit = message.read<WorkUnit>();
+                // a failed unit is reported, the coordinator decides whether it is tried again
+                network::MessageWriter reply;
+                try
+                {
+                    if (jobError.has_value())
+                        throw std::runtime_error(jobError.value());
+                    const std::vector<float> texels = renderer_.renderRegion(
+                        camera_, {job.width, job.height}, {unit.originX, unit.originY}, unit.sampleOffset,
+                        unit.samples);
+                    reply.write(DistributedMessage::Result).write(unit.id).write(texels);
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << std::format("Unit {}: {}", unit.id, e.what()) << std::endl;
+                    reply = network::MessageWriter();
+                    reply.write(DistributedMessage::Failed).write(unit.id).write(std::string(e.what()));
+                }
+                socket.send(reply.data());
+            }
+            else
+            {
+                throw std::runtime_error("Unexpected message from the coordinator!");
+            }
+        }
+        if (initialized)
+            renderer_.cleanup();
+    }
+
+    void Engine::writeOfflineOutput(const std::string& path)
+    {
+        const std::string extension = std::filesystem::path(path).extension().string();
+        if (extension == ".png")
+        {
+            const renderer::ImageReadback display = renderer_.readDisplay();
+            renderer::writePng(path, display.pixels.data(), display.width, display.height);
+        }
+        else
+        {
+            const renderer::ImageReadback beauty = renderer_.readOutput(renderer::Aov::Beauty);
+            if (extension == ".exr")
+                renderer::writeExr(path, beauty.pixels.data(), beauty.width, beauty.height);
+            else
+                renderer::PfmWriter(path, beauty.width, beauty.height).writeStrip(beauty.pixels.data(), beauty.height);
+        }
+    }
 
-        std::vector<path_tracing::Mesh> scene = halo;
-        scene.insert(scene.end(), light.begin(), light.end());
+    void Engine::loadSceneAsync(const path_tracing::SceneDescription& description)
+    {
+        sceneDescription_ = description;
+        sceneLoad_ = std::async(std::launch::async, path_tracing::loadScene, description);
+    }
+
+    void Engine::pollSceneLoad()
+    {
+        if (!sceneLoad_.valid() || sceneLoad_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return;
 
-        renderer_.uploadPathTracingScene(scene);
-        renderer_.uploadEnvMap("./assets/skyboxes/dikhololo_night_2k.hdr");
+        // a missing or broken asset keeps the current scene on screen
+        try
+        {
+            renderer_.stageScene(sceneLoad_.get());
+            sceneLoadError_.clear();
+        }
+        catch (const std::exception& e)
+        {
+            sceneLoadError_ = e.what();
+            std::cerr << "Could not load the scene: " << e.what() << std::endl;
+        }
     }
 
     void Engine::initWindow()
@@ -76,32 +288,32 @@ namespace engine
         if (keysArePressed_['W'] && focused_)
         {
             camera_.moveForward(deltaTime);
-            renderer_.resetAccumulation();
+            renderer_.reprojectAccumulation();
         }
         if (keysArePressed_['S'] && focused_)
         {
             camera_.moveBackward(deltaTime);
-            renderer_.resetAccumulation();
+            renderer_.reprojectAccumulation();
         }
         if (keysArePressed_['A'] && focused_)
         {
             camera_.moveLeft(deltaTime);
-            renderer_.resetAccumulation();
+            renderer_.reprojectAccumulation();
         }
         if (keysArePressed_['D'] && focused_)
         {
             camera_.moveRight(deltaTime);
-            renderer_.resetAccumulation();
+            renderer_.reprojectAccumulation();
         }
         if (keysArePressed_['Q'] && focused_)
         {
             camera_.moveDown(deltaTime);
-            renderer_.resetAccumulation();
+            renderer_.reprojectAccumulation();
         }
         if (keysArePressed_[' '] && focused_)
         {
             camera_.moveUp(deltaTime);
-            renderer_.resetAccumulation();
+            renderer_.reprojectAccumulation();
         }
     }
 
@@ -121,7 +333,7 @@ namespace engine
         float yOffset = lastMousePosition_.y - ypos;
 
         if (abs(xOffset) > 0.0 || abs(yOffset) > 0.0)
-            renderer_.resetAccumulation();
+            renderer_.reprojectAccumulation();
 
         lastMousePosition_.x = xpos;
         lastMousePosition_.y = ypos;
@@ -152,6 +364,7 @@ namespace engine
             keyInput();
             glfwPollEvents();
             camera_.updateMatrix();
+            pollSceneLoad();
 
             renderer_.newImGuiFrame();
             ImGui::NewFrame();
@@ -172,16 +385,161 @@ namespace engine
                                                  &renderer_.ptPushConstants_.envMapIntensity, 0.0, 40.0);
                     change |= ImGui::SliderInt("Show environment map",
                                                reinterpret_cast<int*>(&renderer_.ptPushConstants_.envMapVisible), 0, 1);
+                    change |= ImGui::SliderInt("Environment importance sampling",
+                                               reinterpret_cast<int*>(&renderer_.ptPushConstants_.
+                                                   envImportanceSampling), 0, 1);
+                    change |= ImGui::SliderInt("Emissive triangle sampling",
+                                               reinterpret_cast<int*>(&renderer_.ptPushConstants_.lightSampling), 0, 1);
+                    change |= ImGui::SliderInt("Sobol sampler",
+                                               reinterpret_cast<int*>(&renderer_.ptPushConstants_.sobolSampling), 0, 1);
                     change |= ImGui::SliderInt("Smooth shading",
                                                reinterpret_cast<int*>(&renderer_.ptPushConstants_.smoothShading), 0, 1);
+                    change |= ImGui::Checkbox("BRDF debugging", &renderer_.brdfDebugging_);
+                    ImGui::Checkbox("Specialized shader variants", &renderer_.specializeShaders_);
+                    if (renderer_.rayQuerySupported())
+                        change |= ImGui::Checkbox("Hardware ray queries", &renderer_.rayQuery_);
+                    else
+                        ImGui::TextDisabled("Hardware ray queries unsupported, tracing the software BVH");
+
+                    int mode = static_cast<int>(renderer_.pathTracingMode_);
+                    auto modeName = [](void*, int index)
+                    {
+                        return renderer::pathTracingModeName(static_cast<renderer::PathTracingMode>(index));
+                    };
+                    if (ImGui::Combo("Mode", &mode, modeName, nullptr,
+                                     static_cast<int>(renderer::PathTracingMode::Count)))
+                    {
+                        renderer_.pathTracingMode_ = static_cast<renderer::PathTracingMode>(mode);
+                        change = true;
+                    }
+                    if (renderer_.pathTracingMode_ == renderer::PathTracingMode::Megakernel)
+                    {
+                        change |= ImGui::Checkbox("Adaptive sampling", &renderer_.adaptiveSampling_);
+                        if (renderer_.adaptiveSampling_)
+                        {
+                            change |= ImGui::SliderFloat("Error threshold",
+                                                         &renderer_.ptPushConstants_.adaptiveThreshold, 0.001f, 0.2f,
+                                                         "%.3f", ImGuiSliderFlags_Logarithmic);
+                            change |= ImGui::SliderInt("Minimum frames",
+                                                       reinterpret_cast<int*>(&renderer_.ptPushConstants_.
+                                                           adaptiveMinFrames), 1, 256);
+                        }
+                    }
+                    if (renderer_.pathTracingMode_ == renderer::PathTracingMode::PersistentThreads)
+                    {
+                        ImGui::SliderInt("Persistent workgroups",
+                                         reinterpret_cast<int*>(&renderer_.persistentWorkgroups_), 1, 4096);
+                    }
+                    ImGui::Text("Path tracing: %.2f ms per pass (GPU)", renderer_.pathTracingTimeMs());
+                    if (renderer_.isBenchmarking())
+                        ImGui::Text("Benchmarking...");
+                    else if (ImGui::Button("Benchmark modes"))
+                        renderer_.startBenchmark(BENCHMARK_FRAMES);
+                    if (!renderer_.benchmarkResult().empty())
+                        ImGui::Text("%s", renderer_.benchmarkResult().c_str());
+                }
+                if (ImGui::CollapsingHeader("Temporal reprojection", ImGuiTreeNodeFlags_DefaultOpen))
+                {
+                    // only used when the camera moves
+                    ImGui::Checkbox("Reproject on camera motion", &renderer_.temporalReprojection_);
+                    if (renderer_.adaptiveSampling_)
+                        ImGui::TextDisabled("Resets instead while adaptive sampling is on");
+                    ImGui::SliderInt("History limit", reinterpret_cast<int*>(&renderer_.rpPushConstants_.maxFrames),
+                                     1, 256);
+                    ImGui::SliderFloat("Reprojection depth tolerance", &renderer_.rpPushConstants_.depthTolerance,
+                                       0.001, 0.5);
+                    ImGui::SliderFloat("Reprojection normal tolerance", &renderer_.rpPushConstants_.normalTolerance,
+                                       0.0, 1.0);
+                }
+                if (ImGui::CollapsingHeader("Frame time budget", ImGuiTreeNodeFlags_DefaultOpen))
+                {
+                    ImGui::SliderFloat("Target path tracing time (ms)", &renderer_.targetFrameTimeMs_, 2.0, 100.0);
+                    ImGui::Checkbox("Interleave pixels on camera motion", &renderer_.dynamicResolution_);
+                    if (renderer_.adaptiveSampling_)
+                        ImGui::TextDisabled("Full resolution while adaptive sampling is on");
+                    ImGui::Checkbox("Accumulate passes up to the target", &renderer_.timeBudget_);
+                    ImGui::SliderInt("Max passes per frame",
+                                     reinterpret_cast<int*>(&renderer_.maxPassesPerFrame_), 1, 128);
+                    ImGui::Text("Tracing 1 of %u x %u pixels, %u passes per frame", renderer_.interleave(),
+                                renderer_.interleave(), renderer_.passesPerFrame());
+                }
+                if (ImGui::CollapsingHeader("Denoising", ImGuiTreeNodeFlags_DefaultOpen))
+                {
+                    // filters the displayed image only, the accumulation keeps going underneath
+                    ImGui::Checkbox("Edge-aware denoiser", &renderer_.denoising_);
+                    if (renderer_.denoising_)
+                    {
+                        ImGui::SliderInt("Filter iterations",
+                                         reinterpret_cast<int*>(&renderer_.denoisingIterations_), 1, 5);
+                        ImGui::SliderFloat("Color tolerance", &renderer_.dnPushConstants_.phiColor, 0.1, 16.0);
+                        ImGui::SliderFloat("Normal exponent", &renderer_.dnPushConstants_.phiNormal, 1.0, 256.0);
+                        ImGui::SliderFloat("Depth tolerance", &renderer_.dnPushConstants_.phiDepth, 0.01, 1.0);
+                    }
                 }
                 if (ImGui::CollapsingHeader("Post processing", ImGuiTreeNodeFlags_DefaultOpen))
                 {
+                    int aov = static_cast<int>(renderer_.ppPushConstants_.aov);
+                    auto aovName = [](void*, int index)
+                    {
+                        return renderer::aovName(static_cast<renderer::Aov>(index));
+                    };
+                    if (ImGui::Combo("Display", &aov, aovName, nullptr, static_cast<int>(renderer::Aov::Count)))
+                        renderer_.ppPushConstants_.aov = static_cast<renderer::Aov>(aov);
                     change |= ImGui::SliderInt("Tonemapping",
                                                reinterpret_cast<int*>(&renderer_.ppPushConstants_.method), 0, 1);
                     change |= ImGui::SliderFloat("Exposure value (method 1)", &renderer_.ppPushConstants_.exposure, 0.0,
                                                  10.0);
                 }
+                if (ImGui::CollapsingHeader("Scene", ImGuiTreeNodeFlags_DefaultOpen))
+                {
+                    if (sceneLoad_.valid() || renderer_.hasStagedScene())
+                        ImGui::Text("Loading scene...");
+                    else if (ImGui::Button("Reload scene"))
+                        loadSceneAsync(sceneDescription_);
+                    if (!sceneLoadError_.empty())
+                        ImGui::TextWrapped("Could not load the scene: %s", sceneLoadError_.c_str());
+                }
+                if (ImGui::CollapsingHeader("Memory"))
+                {
+                    const renderer::MemoryReport report = renderer_.memoryReport();
+                    for (uint32_t i = 0; i < static_cast<uint32_t>(renderer::MemoryCategory::Count); i++)
+                    {
+                        ImGui::Text("%s: %s", renderer::memoryCategoryName(static_cast<renderer::MemoryCategory>(i)),
+                                    renderer::formatBytes(report.categories[i]).c_str());
+                    }
+                    ImGui::Separator();
+                    for (size_t i = 0; i < report.heaps.size(); i++)
+                    {
+                        const auto& heap = report.heaps[i];
+                        ImGui::Text("Heap %zu (%s): %s / %s", i, heap.deviceLocal ? "device" : "host",
+                                    renderer::formatBytes(heap.usage).c_str(),
+                                    renderer::formatBytes(heap.budget).c_str());
+                    }
+                    if (!report.budgetExtension)
+                        ImGui::TextDisabled("VK_EXT_memory_budget unavailable, budgets are estimated");
+                    if (report.nearBudget())
+                        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.2f, 1.0f), "Close to the device memory budget");
+                    if (ImGui::Button("Log memory report"))
+                        renderer_.logMemoryReport();
+                }
+                if (ImGui::CollapsingHeader("Tiled render"))
+                {
+                    ImGui::DragInt("Output width", reinterpret_cast<int*>(&tiledRender_.width), 16.0f, 1, 65536);
+                    ImGui::DragInt("Output height", reinterpret_cast<int*>(&tiledRender_.height), 16.0f, 1, 65536);
+                    ImGui::SliderInt("Frames per tile", reinterpret_cast<int*>(&tiledRender_.framesPerTile), 1, 4096);
+                    // blocks the window until the image is written
+                    if (ImGui::Button("Render to tiled_render.pfm"))
+                    {
+                        try
+                        {
+                            renderer_.renderTiled(camera_, tiledRender_);
+                        }
+                        catch (const std::runtime_error& e)
+                        {
+                            std::cerr << e.what() << std::endl;
+                        }
+                    }
+                }
                 if (change)
                     renderer_.resetAccumulation();
                 ImGui::End();
@@ -4,31 +4,67 @@
 #include <GLFW/glfw3.h>
 #include <imgui.h>
 #include <array>
+#include <future>
+#include <optional>
+#include <set>
 
+#include "command_line.h"
 #include "core/camera.h"
 #include "renderer/renderer.h"
+#include "path_tracing/scene.h"
 
 namespace engine
 {
+    // Assets kept between the jobs of an offline render
+    struct OfflineScene
+    {
+        path_tracing::SceneCache cache;
+        std::optional<std::vector<std::filesystem::path>> models; // loaded by the last job
+        std::vector<renderer::MeshHandle> meshes;
+        std::vector<path_tracing::Material> baseMaterials; // as in the models, without overrides
+        std::set<uint32_t> overriddenMeshes;
+    };
+
     class Engine
     {
+        static constexpr uint32_t BENCHMARK_FRAMES = 120;
+
     public:
         void init();
         void run();
         void cleanup();
+        // Renders the jobs one after the other without opening a window, the assets stay loaded between them
+        void renderOffline(const std::vector<OfflineRenderSettings>& jobs);
+        // Renders the work units of a coordinator until it has none left
+        void runWorker(const std::string& host, uint16_t port);
 
     private:
         void initWindow();
         void initImGui();
+        // .png is the tone mapped display image, .exr and .pfm the accumulated radiance
+        void writeOfflineOutput(const std::string& path);
+        void initOffline(VkExtent2D extent);
+        // Loads or updates the scene of the job and sets up its camera, reusing what the jobs before left resident
+        void prepareOfflineJob(const OfflineRenderSettings& job);
         void keyCallback(GLFWwindow* window, int key);
         void mouseCallback(GLFWwindow* window, float xpos, float ypos);
         void mouseButtonCallback(GLFWwindow* window, int button, int action);
         void keyInput();
+        // Loads on a worker thread, the renderer swaps the scene in once it is uploaded
+        void loadSceneAsync(const path_tracing::SceneDescription& description);
+        void pollSceneLoad();
 
         GLFWwindow* window_ = nullptr;
         ImGuiIO* io = nullptr;
         core::Camera camera_ = {35.0f, static_cast<float>(WIDTH) / static_cast<float>(HEIGHT)};
         renderer::Renderer renderer_{};
+        path_tracing::SceneDescription sceneDescription_;
+        std::future<path_tracing::SceneData> sceneLoad_;
+        std::string sceneLoadError_; // of the last load, empty once a scene loaded
+        OfflineScene offlineScene_;
+        renderer::TiledRenderSettings tiledRender_ = {
+            .path = "tiled_render.pfm", .width = 7680, .height = 4320, .framesPerTile = 64
+        };
 
         // Controls
         bool focused_ = false;
@@ -0,0 +1,223 @@
+#include "socket.h"
+
+#include <algorithm>
+#include <format>
+#include <limits>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace network
+{
+    namespace
+    {
+#ifdef _WIN32
+        constexpr SocketHandle INVALID_HANDLE = INVALID_SOCKET;
+
+        void closeHandle(SocketHandle handle) { closesocket(handle); }
+
+        int pollHandle(SocketHandle handle, int timeoutMs)
+        {
+            WSAPOLLFD descriptor = {.fd = handle, .events = POLLIN};
+            return WSAPoll(&descriptor, 1, timeoutMs);
+        }
+
+        // Winsock has to be started once per process before the first socket
+        void initialize()
+        {
+            static const bool started = []()
+            {
+                WSADATA data;
+                if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+                    throw std::runtime_error("Could not start Winsock!");
+                return true;
+            }();
+            (void)started;
+        }
+#else
+        constexpr SocketHandle INVALID_HANDLE = -1;
+
+        void closeHandle(SocketHandle handle) { ::close(handle); }
+
+        int pollHandle(SocketHandle handle, int timeoutMs)
+        {
+            pollfd descriptor = {.fd = handle, .events = POLLIN};
+            return poll(&descriptor, 1, timeoutMs);
+        }
+
+        void initialize() {}
+#endif
+
+        // the results are large and latency matters more than the packet count
+        void disableNagle(SocketHandle handle)
+        {
+            int enabled = 1;
+            setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enabled), sizeof(enabled));
+        }
+
+        // refuses messages that cannot be meant, a corrupt size would otherwise allocate the memory
+        constexpr uint64_t MAX_MESSAGE_SIZE = 4ull * 1024 * 1024 * 1024;
+    }
+
+    Socket::Socket(Socket&& other) noexcept : handle_(std::exchange(other.handle_, std::nullopt))
+    {
+    }
+
+    Socket& Socket::operator=(Socket&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            handle_ = std::exchange(other.handle_, std::nullopt);
+        }
+        return *this;
+    }
+
+    Socket::~Socket()
+    {
+        close();
+    }
+
+    void Socket::close()
+    {
+        if (handle_.has_value())
+            closeHandle(handle_.value());
+        handle_.reset();
+    }
+
+    Socket Socket::connect(const std::string& host, uint16_t port)
+    {
+        initialize();
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+            throw std::runtime_error(std::format("Could not resolve {}!", host));
+
+        for (const addrinfo* address = addresses; address != nullptr; address = address->ai_next)
+        {
+            const SocketHandle handle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (handle == INVALID_HANDLE)
+                continue;
+            if (::connect(handle, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0)
+            {
+                freeaddrinfo(addresses);
+                disableNagle(handle);
+                return Socket(handle);
+            }
+            closeHandle(handle);
+        }
+        freeaddrinfo(addresses);
+        throw std::runtime_error(std::format("Could not connect to {}:{}!", host, port));
+    }
+
+    void Socket::send(const std::vector<uint8_t>& message)
+    {
+        const uint64_t size = message.size();
+        sendBytes(&size, sizeof(size));
+        sendBytes(message.data(), message.size());
+    }
+
+    std::vector<uint8_t> Socket::receive()
+    {
+        uint64_t size = 0;
+        receiveBytes(&size, sizeof(size));
+        if (size > MAX_MESSAGE_SIZE)
+            throw std::runtime_error("Received a message of an invalid size!");
+        std::vector<uint8_t> message(size);
+        receiveBytes(message.data(), message.size());
+        return message;
+    }
+
+    void Socket::sendBytes(const void* data, size_t size)
+    {
+        if (!handle_.has_value())
+            throw std::runtime_error("Sending on a closed connection!");
+        const auto* bytes = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            const int chunk = static_cast<int>(std::min<size_t>(size, std::numeric_limits<int>::max()));
+#ifdef _WIN32
+            const auto sent = ::send(handle_.value(), bytes, chunk, 0);
+#else
+            // a closed peer is reported as an error instead of a signal
+            const auto sent = ::send(handle_.value(), bytes, chunk, MSG_NOSIGNAL);
+#endif
+            if (sent <= 0)
+            {
+                close();
+                throw std::runtime_error("The connection was lost while sending!");
+            }
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+    }
+
+    void Socket::receiveBytes(void* data, size_t size)
+    {
+        if (!handle_.has_value())
+            throw std::runtime_error("Receiving on a closed connection!");
+        auto* bytes = static_cast<char*>(data);
+        while (size > 0)
+        {
+            const int chunk = static_cast<int>(std::min<size_t>(size, std::numeric_limits<int>::max()));
+            const auto received = recv(handle_.value(), bytes, chunk, 0);
+            if (received <= 0)
+            {
+                close();
+                throw std::runtime_error("The connection was lost while receiving!");
+            }
+            bytes += received;
+            size -= static_cast<size_t>(received);
+        }
+    }
+
+    Listener::Listener(uint16_t port)
+    {
+        initialize();
+        handle_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (handle_ == INVALID_HANDLE)
+            throw std::runtime_error("Could not create the listening socket!");
+
+        // a restarted coordinator can take the port over right away
+        int reuse = 1;
+        setsockopt(handle_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (bind(handle_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(handle_, SOMAXCONN) != 0)
+        {
+            closeHandle(handle_);
+            throw std::runtime_error(std::format("Could not listen on port {}!", port));
+        }
+    }
+
+    Listener::~Listener()
+    {
+        closeHandle(handle_);
+    }
+
+    std::optional<Socket> Listener::accept(std::chrono::milliseconds timeout)
+    {
+        if (pollHandle(handle_, static_cast<int>(timeout.count())) <= 0)
+            return std::nullopt;
+        const SocketHandle connection = ::accept(handle_, nullptr, nullptr);
+        if (connection == INVALID_HANDLE)
+            return std::nullopt;
+        disableNagle(connection);
+        return Socket(connection);
+    }
+} // network
@@ -0,0 +1,141 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace network
+{
+#ifdef _WIN32
+    using SocketHandle = uintptr_t;
+#else
+    using SocketHandle = int;
+#endif
+
+    // Blocking TCP connection exchanging messages prefixed with their size. Throws once the connection is lost.
+    class Socket
+    {
+    public:
+        Socket() = default;
+        explicit Socket(SocketHandle handle) : handle_(handle) {}
+        Socket(Socket&& other) noexcept;
+        Socket& operator=(Socket&& other) noexcept;
+        Socket(const Socket&) = delete;
+        Socket& operator=(const Socket&) = delete;
+        ~Socket();
+
+        static Socket connect(const std::string& host, uint16_t port);
+        void send(const std::vector<uint8_t>& message);
+        std::vector<uint8_t> receive();
+        bool valid() const { return handle_.has_value(); }
+
+    private:
+        void sendBytes(const void* data, size_t size);
+        void receiveBytes(void* data, size_t size);
+        void close();
+
+        std::optional<SocketHandle> handle_;
+    };
+
+    // Accepts connections from every interface, so that workers can run on other machines
+    class Listener
+    {
+    public:
+        explicit Listener(uint16_t port);
+        Listener(const Listener&) = delete;
+        Listener& operator=(const Listener&) = delete;
+        ~Listener();
+
+        // std::nullopt when nobody connected within the timeout
+        std::optional<Socket> accept(std::chrono::milliseconds timeout);
+
+    private:
+        SocketHandle handle_;
+    };
+
+    // Little endian on every supported platform, the values are copied as they are in memory
+    class MessageWriter
+    {
+    public:
+        template <typename T>
+        MessageWriter& write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+            data_.insert(data_.end(), bytes, bytes + sizeof(T));
+            return *this;
+        }
+
+        template <typename T>
+        MessageWriter& write(const std::vector<T>& values)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            write(static_cast<uint64_t>(values.size()));
+            const auto* bytes = reinterpret_cast<const uint8_t*>(values.data());
+            data_.insert(data_.end(), bytes, bytes + values.size() * sizeof(T));
+            return *this;
+        }
+
+        MessageWriter& write(const std::string& value)
+        {
+            return write(std::vector<char>(value.begin(), value.end()));
+        }
+
+        const std::vector<uint8_t>& data() const { return data_; }
+
+    private:
+        std::vector<uint8_t> data_;
+    };
+
+    class MessageReader
+    {
+    public:
+        explicit MessageReader(std::vector<uint8_t> data) : data_(std::move(data)) {}
+
+        template <typename T>
+        T read()
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            T value;
+            memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        template <typename T>
+        std::vector<T> readVector()
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            const auto count = read<uint64_t>();
+            if (count > (data_.size() - offset_) / sizeof(T))
+                throw std::runtime_error("Truncated message!");
+            std::vector<T> values(count);
+            if (count == 0)
+                return values;
+            memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+            return values;
+        }
+
+        std::string readString()
+        {
+            const std::vector<char> characters = readVector<char>();
+            return {characters.begin(), characters.end()};
+        }
+
+    private:
+        const uint8_t* take(size_t size)
+        {
+            if (size > data_.size() - offset_)
+                throw std::runtime_error("Truncated message!");
+            const uint8_t* data = data_.data() + offset_;
+            offset_ += size;
+            return data;
+        }
+
+        std::vector<uint8_t> data_;
+        size_t offset_ = 0;
+    };
+} // network
@@ -1,5 +1,6 @@
 #include "geometry.h"
 #include <iostream>
+#include <algorithm>
 
 namespace path_tracing
 {
@@ -142,4 +143,66 @@ namespace path_tracing
                 << node.triangleCount << std::endl;
         }
     }
+
+    // same slab test as rayAABBIntersect in path_tracing.comp
+    static float rayAABBIntersect(const glm::vec3& origin, const glm::vec3& invDirection, const BVHNode& node)
+    {
+        const glm::vec3 t1 = (node.aabbMin - origin) * invDirection;
+        const glm::vec3 t2 = (node.aabbMax - origin) * invDirection;
+        const glm::vec3 tNear = glm::min(t1, t2);
+        const glm::vec3 tFar = glm::max(t1, t2);
+        const float tmin = std::max(std::max(tNear.x, tNear.y), tNear.z);
+        const float tmax = std::min(std::min(tFar.x, tFar.y), tFar.z);
+        return tmax >= tmin && tmax > 0.0f ? tmin : 1e10f;
+    }
+
+    // same test as rayTriangleIntersect in path_tracing.comp, 1e10 on a miss
+    static float rayTriangleIntersect(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& v0,
+                                      const glm::vec3& v1, const glm::vec3& v2)
+    {
+        const glm::vec3 v1v0 = v1 - v0;
+        const glm::vec3 v2v0 = v2 - v0;
+        const glm::vec3 rov0 = origin - v0;
+        const glm::vec3 n = glm::cross(v1v0, v2v0);
+        const glm::vec3 q = glm::cross(rov0, direction);
+        const float d = 1.0f / glm::dot(direction, n);
+        const float u = d * glm::dot(-q, v2v0);
+        const float v = d * glm::dot(q, v1v0);
+        const float dist = d * glm::dot(-n, rov0);
+        return u >= 0.0f && v >= 0.0f && u + v <= 1.0f && dist > 0.0f ? dist : 1e10f;
+    }
+
+    bool Geometry::occluded(const glm::vec3& origin, const glm::vec3& direction, float tMax) const
+    {
+        if (nodes.empty())
+            return false;
+
+        const glm::vec3 invDirection = 1.0f / direction;
+        uint32_t stack[32];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0)
+        {
+            const BVHNode& node = nodes[stack[--stackSize]];
+            if (node.triangleCount > 0)
+            {
+                for (uint32_t i = node.index; i < node.index + node.triangleCount; i++)
+                {
+                    const Triangle& tri = triangles[i];
+                    if (rayTriangleIntersect(origin, direction, vertices[tri.v0].position, vertices[tri.v1].position,
+                                             vertices[tri.v2].position) < tMax)
+                        return true;
+                }
+            }
+            else
+            {
+                if (rayAABBIntersect(origin, invDirection, nodes[node.index]) < tMax)
+                    stack[stackSize++] = node.index;
+                if (rayAABBIntersect(origin, invDirection, nodes[node.index + 1]) < tMax)
+                    stack[stackSize++] = node.index + 1;
+            }
+        }
+        return false;
+    }
 } // path_tracing
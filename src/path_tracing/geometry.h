@@ -17,6 +17,8 @@ namespace path_tracing
 
         void buildBVH(uint32_t depth = 0);
         void traverseBVH(uint32_t index); // used for debugging only
+        // CPU version of the shader's any-hit traversal, true if a triangle is hit closer than tMax
+        bool occluded(const glm::vec3& origin, const glm::vec3& direction, float tMax) const;
         static glm::vec3 computeTangent(const std::array<core::Vertex, 3>& verts);
 
     private:
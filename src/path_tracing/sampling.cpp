@@ -0,0 +1,154 @@
+#include "sampling.h"
+#include "constants.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "core/parallel.h"
+
+namespace path_tracing
+{
+    // the distribution does not need the full resolution of 8K maps, cells are jittered on the GPU anyway
+    constexpr uint32_t MAX_ENV_SAMPLING_WIDTH = 1024;
+    constexpr uint32_t MAX_ENV_SAMPLING_HEIGHT = 512;
+
+    // Primitive polynomials and initial direction numbers of Joe and Kuo for the dimensions after the first one,
+    // which is the van der Corput sequence
+    struct SobolParameters
+    {
+        uint32_t degree;
+        uint32_t coefficients;
+        uint32_t initial[3];
+    };
+
+    constexpr SobolParameters SOBOL_PARAMETERS[SOBOL_DIMENSIONS - 1] = {
+        {1, 0, {1}},
+        {2, 1, {1, 3}},
+        {3, 1, {1, 3, 1}},
+    };
+
+    std::vector<AliasEntry> buildAliasTable(const std::vector<float>& weights)
+    {
+        const size_t count = weights.size();
+        std::vector<AliasEntry> table(count);
+        if (count == 0)
+            return table;
+
+        const double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+        if (sum <= 0.0)
+        {
+            for (uint32_t i = 0; i < count; i++)
+                table[i] = {1.0f, i, 1.0f / static_cast<float>(count)};
+            return table;
+        }
+
+        std::vector<double> scaled(count);
+        std::vector<uint32_t> small;
+        std::vector<uint32_t> large;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            table[i].pmf = static_cast<float>(weights[i] / sum);
+            scaled[i] = weights[i] * static_cast<double>(count) / sum;
+            if (scaled[i] < 1.0)
+                small.push_back(i);
+            else
+                large.push_back(i);
+        }
+
+        while (!small.empty() && !large.empty())
+        {
+            const uint32_t s = small.back();
+            small.pop_back();
+            const uint32_t l = large.back();
+            large.pop_back();
+
+            table[s].probability = static_cast<float>(scaled[s]);
+            table[s].alias = l;
+
+            // the large entry gives away what the small one was missing
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            if (scaled[l] < 1.0)
+                small.push_back(l);
+            else
+                large.push_back(l);
+        }
+
+        // leftovers are only off by floating point errors
+        for (uint32_t i : large)
+            table[i] = {1.0f, i, table[i].pmf};
+        for (uint32_t i : small)
+            table[i] = {1.0f, i, table[i].pmf};
+
+        return table;
+    }
+
+    std::vector<float> buildEnvironmentDistribution(const std::vector<uint32_t>& texels, VkExtent3D size,
+                                                    uint32_t& width, uint32_t& height)
+    {
+        width = std::min(size.width, MAX_ENV_SAMPLING_WIDTH);
+        height = std::min(size.height, MAX_ENV_SAMPLING_HEIGHT);
+        std::vector<float> weights(static_cast<size_t>(width) * height);
+
+        core::parallelFor(height, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t y = begin; y < end; y++)
+            {
+                // rows near the poles cover less solid angle
+                const float latitude = (0.5f - (static_cast<float>(y) + 0.5f) / static_cast<float>(height)) *
+                    glm::pi<float>();
+                const float cosLatitude = std::cos(latitude);
+
+                const uint32_t srcY0 = y * size.height / height;
+                const uint32_t srcY1 = std::max((y + 1) * size.height / height, srcY0 + 1);
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    const uint32_t srcX0 = x * size.width / width;
+                    const uint32_t srcX1 = std::max((x + 1) * size.width / width, srcX0 + 1);
+
+                    float luminance = 0.0f;
+                    for (uint32_t sy = srcY0; sy < srcY1; sy++)
+                    {
+                        for (uint32_t sx = srcX0; sx < srcX1; sx++)
+                        {
+                            glm::vec3 color = glm::unpackF3x9_E1x5(texels[static_cast<size_t>(sy) * size.width + sx]);
+                            color = glm::min(color, glm::vec3(MAX_ENV_MAP_VALUE));
+                            luminance += glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+                        }
+                    }
+                    luminance /= static_cast<float>((srcY1 - srcY0) * (srcX1 - srcX0));
+
+                    weights[static_cast<size_t>(y) * width + x] = luminance * cosLatitude;
+                }
+            }
+        });
+
+        return weights;
+    }
+
+    std::vector<uint32_t> buildSobolMatrices()
+    {
+        std::vector<uint32_t> matrices(SOBOL_DIMENSIONS * SOBOL_BITS);
+        for (uint32_t bit = 0; bit < SOBOL_BITS; bit++)
+            matrices[bit] = 1u << (31 - bit);
+
+        for (uint32_t dimension = 1; dimension < SOBOL_DIMENSIONS; dimension++)
+        {
+            const SobolParameters& parameters = SOBOL_PARAMETERS[dimension - 1];
+            const uint32_t s = parameters.degree;
+            uint32_t* v = &matrices[dimension * SOBOL_BITS];
+            for (uint32_t bit = 0; bit < s; bit++)
+                v[bit] = parameters.initial[bit] << (31 - bit);
+            // recurrence of the primitive polynomial x^s + a_1 x^(s-1) + ... + a_(s-1) x + 1
+            for (uint32_t bit = s; bit < SOBOL_BITS; bit++)
+            {
+                v[bit] = v[bit - s] ^ (v[bit - s] >> s);
+                for (uint32_t k = 1; k < s; k++)
+                    v[bit] ^= ((parameters.coefficients >> (s - 1 - k)) & 1u) * v[bit - k];
+            }
+        }
+        return matrices;
+    }
+} // path_tracing
@@ -0,0 +1,14 @@
+#pragma once
+#include "types.h"
+#include <vector>
+
+namespace path_tracing
+{
+    // Vose's alias method, lets the GPU draw an index proportionally to its weight in O(1)
+    std::vector<AliasEntry> buildAliasTable(const std::vector<float>& weights);
+    // Luminance * solid angle weights of a (downsampled) E5B9G9R9 equirectangular image
+    std::vector<float> buildEnvironmentDistribution(const std::vector<uint32_t>& texels, VkExtent3D size,
+                                                    uint32_t& width, uint32_t& height);
+    // SOBOL_BITS direction numbers for each of the SOBOL_DIMENSIONS dimensions, laid out dimension after dimension
+    std::vector<uint32_t> buildSobolMatrices();
+} // path_tracing
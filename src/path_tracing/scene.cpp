@@ -0,0 +1,82 @@
+#include "scene.h"
+#include "sampling.h"
+
+#include <cstring>
+
+#include "core/parallel.h"
+#include "vk_utils/vk_images.h"
+
+namespace path_tracing
+{
+    EnvironmentData loadEnvironment(const std::string& path)
+    {
+        EnvironmentData environment;
+        environment.texels = vk_utils::loadHDRTextureData(path, environment.size);
+        environment.aliasTable = buildAliasTable(
+            buildEnvironmentDistribution(environment.texels, environment.size, environment.samplingWidth,
+                                         environment.samplingHeight));
+        return environment;
+    }
+
+    SceneData loadScene(const SceneDescription& description)
+    {
+        SceneData scene;
+        for (const auto& model : description.models)
+        {
+            std::vector<Mesh> meshes = loadFromObj(model);
+            scene.meshes.insert(scene.meshes.end(), meshes.begin(), meshes.end());
+        }
+        loadTextures(scene);
+
+        if (!description.envMap.empty())
+            scene.environment = loadEnvironment(description.envMap);
+
+        return scene;
+    }
+
+    void loadTextures(SceneData& scene, const std::function<bool(const std::string&)>& isResident)
+    {
+        std::vector<std::string> texturePaths;
+        for (const auto& mesh : scene.meshes)
+        {
+            for (const auto& map : {mesh.material.colorMap, mesh.material.roughnessMap, mesh.material.metallicMap,
+                                    mesh.material.normalMap})
+            {
+                if (map.has_value() && !scene.textures.contains(map.value()) &&
+                    !(isResident && isResident(map.value())))
+                {
+                    scene.textures.emplace(map.value(), TextureData{});
+                    texturePaths.push_back(map.value());
+                }
+            }
+        }
+
+        core::parallelFor(static_cast<uint32_t>(texturePaths.size()), [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                // the map itself is not modified here, only the already inserted entries
+                TextureData& texture = scene.textures.at(texturePaths[i]);
+                stbi_uc* data = vk_utils::loadTextureData(texturePaths[i], texture.size);
+                texture.pixels.resize(static_cast<size_t>(texture.size.width) * texture.size.height * 4);
+                memcpy(texture.pixels.data(), data, texture.pixels.size());
+                vk_utils::freeImageData(data);
+            }
+        });
+    }
+
+    SceneData SceneCache::load(const std::vector<std::filesystem::path>& models,
+                               const std::function<bool(const std::string&)>& isTextureResident)
+    {
+        SceneData scene;
+        for (const auto& model : models)
+        {
+            auto it = models_.find(model.string());
+            if (it == models_.end())
+                it = models_.emplace(model.string(), loadFromObj(model)).first;
+            scene.meshes.insert(scene.meshes.end(), it->second.begin(), it->second.end());
+        }
+        loadTextures(scene, isTextureResident);
+        return scene;
+    }
+} // path_tracing
@@ -0,0 +1,59 @@
+#pragma once
+#include "types.h"
+#include "mesh.h"
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace path_tracing
+{
+    struct SceneDescription
+    {
+        std::vector<std::filesystem::path> models;
+        std::string envMap;
+    };
+
+    struct TextureData
+    {
+        std::vector<uint8_t> pixels; // RGBA8
+        VkExtent3D size = {1, 1, 1};
+    };
+
+    struct EnvironmentData
+    {
+        std::vector<uint32_t> texels; // E5B9G9R9
+        VkExtent3D size = {1, 1, 1};
+        std::vector<AliasEntry> aliasTable;
+        uint32_t samplingWidth = 0;
+        uint32_t samplingHeight = 0;
+    };
+
+    // Everything the renderer needs to swap to a new scene, prepared without touching the GPU
+    struct SceneData
+    {
+        std::vector<Mesh> meshes;
+        std::unordered_map<std::string, TextureData> textures; // keyed by the paths used in the materials
+        std::optional<EnvironmentData> environment;
+    };
+
+    EnvironmentData loadEnvironment(const std::string& path);
+    // Safe to call from a worker thread, models, textures and the environment are decoded up front
+    SceneData loadScene(const SceneDescription& description);
+    // Decodes the textures of the materials that are neither in the scene yet nor accepted by isResident
+    void loadTextures(SceneData& scene, const std::function<bool(const std::string&)>& isResident = nullptr);
+
+    // Keeps the parsed models and their BVHs, for renderers that go through many scenes sharing models
+    class SceneCache
+    {
+    public:
+        // Like loadScene without the environment, the textures accepted by isTextureResident are not decoded
+        SceneData load(const std::vector<std::filesystem::path>& models,
+                       const std::function<bool(const std::string&)>& isTextureResident);
+
+    private:
+        std::unordered_map<std::string, std::vector<Mesh>> models_;
+    };
+} // path_tracing
@@ -0,0 +1,133 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <format>
+#include <stdexcept>
+#include <vector>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+namespace renderer
+{
+    PfmWriter::PfmWriter(const std::string& path, uint32_t width, uint32_t height) : file_(path, std::ios::binary),
+        width_(width), height_(height)
+    {
+        if (!file_)
+            throw std::runtime_error(std::format("Could not open {} for writing!", path));
+        // a negative scale marks little endian data
+        static_assert(std::endian::native == std::endian::little);
+        file_ << std::format("PF\n{} {}\n-1.0\n", width, height);
+    }
+
+    void PfmWriter::writeStrip(const float* rgb, uint32_t rowCount)
+    {
+        if (rowsWritten_ + rowCount > height_)
+            throw std::runtime_error("PFM strip runs past the top of the image!");
+        const size_t rowSize = static_cast<size_t>(width_) * 3;
+        for (uint32_t row = rowCount; row-- > 0;)
+            file_.write(reinterpret_cast<const char*>(rgb + row * rowSize), rowSize * sizeof(float));
+        rowsWritten_ += rowCount;
+        if (!file_)
+            throw std::runtime_error("Could not write the PFM image!");
+    }
+
+    void writeExr(const std::string& path, const float* rgb, uint32_t width, uint32_t height)
+    {
+        static_assert(std::endian::native == std::endian::little);
+        std::string header;
+        auto append = [&header](const auto& value)
+        {
+            header.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        auto attribute = [&](const char* name, const char* type, int32_t size)
+        {
+            header.append(name).push_back('\0');
+            header.append(type).push_back('\0');
+            append(size);
+        };
+
+        append(int32_t{20000630}); // magic number
+        append(int32_t{2}); // version 2, single part scanline image
+
+        // the channels are stored in alphabetical order, as 32 bit floats
+        constexpr std::array<char, 3> CHANNELS = {'B', 'G', 'R'};
+        constexpr int32_t FLOAT_PIXELS = 2;
+        attribute("channels", "chlist", static_cast<int32_t>(CHANNELS.size() * 18 + 1));
+        for (char channel : CHANNELS)
+        {
+            header.push_back(channel);
+            header.push_back('\0');
+            append(FLOAT_PIXELS);
+            append(int32_t{0}); // pLinear and reserved bytes
+            append(int32_t{1}); // x sampling
+            append(int32_t{1}); // y sampling
+        }
+        header.push_back('\0');
+        attribute("compression", "compression", 1);
+        header.push_back('\0'); // none
+        const std::array<int32_t, 4> window = {0, 0, static_cast<int32_t>(width) - 1, static_cast<int32_t>(height) - 1};
+        attribute("dataWindow", "box2i", sizeof(window));
+        append(window);
+        attribute("displayWindow", "box2i", sizeof(window));
+        append(window);
+        attribute("lineOrder", "lineOrder", 1);
+        header.push_back('\0'); // increasing y
+        attribute("pixelAspectRatio", "float", sizeof(float));
+        append(1.0f);
+        attribute("screenWindowCenter", "v2f", 2 * sizeof(float));
+        append(0.0f);
+        append(0.0f);
+        attribute("screenWindowWidth", "float", sizeof(float));
+        append(1.0f);
+        header.push_back('\0');
+
+        // one scanline per block, each one behind the table of their offsets
+        const uint64_t blockSize = 2 * sizeof(int32_t) + static_cast<uint64_t>(width) * CHANNELS.size() * sizeof(float);
+        const uint64_t firstBlock = header.size() + static_cast<uint64_t>(height) * sizeof(uint64_t);
+        for (uint32_t y = 0; y < height; y++)
+            append(firstBlock + y * blockSize);
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            throw std::runtime_error(std::format("Could not open {} for writing!", path));
+        file.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+        std::vector<float> channels(static_cast<size_t>(width) * CHANNELS.size());
+        const int32_t dataSize = static_cast<int32_t>(channels.size() * sizeof(float));
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const float* row = rgb + static_cast<size_t>(y) * width * 3;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                channels[x] = row[x * 3 + 2];
+                channels[width + x] = row[x * 3 + 1];
+                channels[2 * width + x] = row[x * 3];
+            }
+            const int32_t line = static_cast<int32_t>(y);
+            file.write(reinterpret_cast<const char*>(&line), sizeof(line));
+            file.write(reinterpret_cast<const char*>(&dataSize), sizeof(dataSize));
+            file.write(reinterpret_cast<const char*>(channels.data()), dataSize);
+        }
+        if (!file)
+            throw std::runtime_error("Could not write the OpenEXR image!");
+    }
+
+    void writePng(const std::string& path, const float* rgb, uint32_t width, uint32_t height)
+    {
+        std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            const float linear = std::clamp(rgb[i], 0.0f, 1.0f);
+            const float encoded = linear <= 0.0031308f
+                                      ? 12.92f * linear
+                                      : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+            pixels[i] = static_cast<uint8_t>(std::lround(encoded * 255.0f));
+        }
+        if (!stbi_write_png(path.c_str(), static_cast<int>(width), static_cast<int>(height), 3, pixels.data(),
+                            static_cast<int>(width * 3)))
+            throw std::runtime_error(std::format("Could not write {}!", path));
+    }
+} // renderer
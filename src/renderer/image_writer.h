@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace renderer
+{
+    // Streams a linear float RGB image into a PFM file. PFM stores the rows from the bottom up, so the image is
+    // handed over in strips starting at the bottom, each one directly above the previous one.
+    class PfmWriter
+    {
+    public:
+        PfmWriter(const std::string& path, uint32_t width, uint32_t height);
+        // rowCount rows of width rgb floats, ordered top to bottom within the strip
+        void writeStrip(const float* rgb, uint32_t rowCount);
+        bool complete() const { return rowsWritten_ == height_; }
+
+    private:
+        std::ofstream file_;
+        uint32_t width_;
+        uint32_t height_;
+        uint32_t rowsWritten_ = 0;
+    };
+
+    // Linear float RGB rows, top to bottom, as an uncompressed single part scanline OpenEXR image
+    void writeExr(const std::string& path, const float* rgb, uint32_t width, uint32_t height);
+    // Encodes linear RGB in [0, 1] to 8 bit sRGB
+    void writePng(const std::string& path, const float* rgb, uint32_t width, uint32_t height);
+} // renderer
@@ -0,0 +1,73 @@
+#include "memory_report.h"
+
+#include <format>
+
+namespace renderer
+{
+    VkDeviceSize MemoryReport::deviceLocalUsage() const
+    {
+        VkDeviceSize usage = 0;
+        for (const auto& heap : heaps)
+            usage += heap.deviceLocal ? heap.usage : 0;
+        return usage;
+    }
+
+    VkDeviceSize MemoryReport::deviceLocalBudget() const
+    {
+        VkDeviceSize budget = 0;
+        for (const auto& heap : heaps)
+            budget += heap.deviceLocal ? heap.budget : 0;
+        return budget;
+    }
+
+    bool MemoryReport::nearBudget(VkDeviceSize additional) const
+    {
+        const VkDeviceSize budget = deviceLocalBudget();
+        return budget > 0 && static_cast<double>(deviceLocalUsage() + additional) >
+            static_cast<double>(budget) * MEMORY_BUDGET_WARNING_THRESHOLD;
+    }
+
+    std::string MemoryReport::toString() const
+    {
+        std::string report = "GPU memory report\n";
+        for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); i++)
+        {
+            report += std::format("  {:<16} {:>12}\n", memoryCategoryName(static_cast<MemoryCategory>(i)),
+                                  formatBytes(categories[i]));
+        }
+        for (size_t i = 0; i < heaps.size(); i++)
+        {
+            report += std::format("  heap {} {:<12} {:>12} / {:>12} (size {}){}\n", i,
+                                  heaps[i].deviceLocal ? "device local" : "host",
+                                  formatBytes(heaps[i].usage), formatBytes(heaps[i].budget),
+                                  formatBytes(heaps[i].size), budgetExtension ? "" : " estimated budget");
+        }
+        return report;
+    }
+
+    const char* memoryCategoryName(MemoryCategory category)
+    {
+        switch (category)
+        {
+        case MemoryCategory::Geometry: return "Geometry";
+        case MemoryCategory::BVH: return "BVH";
+        case MemoryCategory::Materials: return "Materials";
+        case MemoryCategory::SceneHeapFree: return "Scene heap free";
+        case MemoryCategory::Textures: return "Textures";
+        case MemoryCategory::Environment: return "Environment";
+        case MemoryCategory::Framebuffers: return "Framebuffers";
+        case MemoryCategory::Staging: return "Staging";
+        case MemoryCategory::Wavefront: return "Wavefront queues";
+        default: return "Unknown";
+        }
+    }
+
+    std::string formatBytes(VkDeviceSize bytes)
+    {
+        if (bytes >= 1024ull * 1024 * 1024)
+            return std::format("{:.2f} GiB", static_cast<double>(bytes) / (1024.0 * 1024.0 * 1024.0));
+        if (bytes >= 1024ull * 1024)
+            return std::format("{:.1f} MiB", static_cast<double>(bytes) / (1024.0 * 1024.0));
+        return std::format("{:.1f} KiB", static_cast<double>(bytes) / 1024.0);
+    }
+} // renderer
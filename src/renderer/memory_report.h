@@ -0,0 +1,52 @@
+#pragma once
+#include "types.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace renderer
+{
+    enum class MemoryCategory : uint32_t
+    {
+        Geometry = 0, // vertices and triangles
+        BVH,
+        Materials, // materials, mesh infos and scene headers
+        SceneHeapFree, // allocated for the scene heap but not handed out yet
+        Textures,
+        Environment,
+        Framebuffers,
+        Staging,
+        Wavefront, // path queues of the wavefront mode, allocated on first use
+        Count
+    };
+
+    // warn once the device local usage would get past this fraction of the budget
+    constexpr float MEMORY_BUDGET_WARNING_THRESHOLD = 0.9f;
+
+    struct MemoryHeapReport
+    {
+        VkDeviceSize usage = 0; // whole process, including allocations outside of VMA when the budget extension is on
+        VkDeviceSize budget = 0;
+        VkDeviceSize size = 0;
+        bool deviceLocal = false;
+    };
+
+    struct MemoryReport
+    {
+        std::array<VkDeviceSize, static_cast<size_t>(MemoryCategory::Count)> categories{};
+        std::vector<MemoryHeapReport> heaps;
+        bool budgetExtension = false; // without it the budget is VMA's estimate of 80% of the heap size
+
+        VkDeviceSize& operator[](MemoryCategory category) { return categories[static_cast<size_t>(category)]; }
+        VkDeviceSize operator[](MemoryCategory category) const { return categories[static_cast<size_t>(category)]; }
+        VkDeviceSize deviceLocalUsage() const;
+        VkDeviceSize deviceLocalBudget() const;
+        // True when adding this many bytes would cross the warning threshold
+        bool nearBudget(VkDeviceSize additional = 0) const;
+        std::string toString() const;
+    };
+
+    const char* memoryCategoryName(MemoryCategory category);
+    std::string formatBytes(VkDeviceSize bytes);
+} // renderer
@@ -8,8 +8,12 @@
 #include <fstream>
 #include <cassert>
 #include <string>
+#include <string_view>
 #include <set>
 #include <array>
+#include <iostream>
+#include <format>
+#include <glm/gtc/packing.hpp>
 
 #include <backends/imgui_impl_glfw.h>
 #include <backends/imgui_impl_vulkan.h>
@@ -18,19 +22,63 @@
 #include "vk_utils/vk_shaders.h"
 #include "vk_utils/vk_compatibility.h"
 #include "vk_utils/vk_infos.h"
+#include "vk_utils/vk_pipeline_cache.h"
+#include "vk_utils/vk_acceleration_structure.h"
 #include "path_tracing/geometry.h"
 #include "path_tracing/mesh.h"
+#include "path_tracing/sampling.h"
+#include "path_tracing/scene.h"
+#include "renderer/image_writer.h"
 
 namespace renderer
 {
+    const char* pathTracingModeName(PathTracingMode mode)
+    {
+        switch (mode)
+        {
+        case PathTracingMode::Megakernel: return "Megakernel";
+        case PathTracingMode::Wavefront: return "Wavefront";
+        case PathTracingMode::PersistentThreads: return "Persistent threads";
+        default: return "Unknown";
+        }
+    }
+
+    const char* aovName(Aov aov)
+    {
+        switch (aov)
+        {
+        case Aov::Beauty: return "Beauty";
+        case Aov::Albedo: return "Albedo";
+        case Aov::Normal: return "Normal";
+        case Aov::Depth: return "Depth";
+        case Aov::MeshId: return "Mesh ID";
+        case Aov::MaterialId: return "Material ID";
+        case Aov::HitCount: return "Hit count";
+        default: return "Unknown";
+        }
+    }
+
     void Renderer::init(GLFWwindow* window)
     {
         initVulkan(window);
         initImguiBackend(window);
+        initResources();
+    }
+
+    void Renderer::initHeadless(VkExtent2D extent)
+    {
+        headless_ = true;
+        swapchainExtent_ = extent;
+        initVulkan(nullptr);
+        initResources();
+    }
 
+    void Renderer::initResources()
+    {
         std::vector<vk_utils::DescriptorAllocator::PoolSizeRatio> sizes =
         {
             {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
             {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3},
             {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 30},
         };
@@ -39,7 +87,8 @@ namespace renderer
         drawImage_ = createImage(
             {swapchainExtent_.width, swapchainExtent_.height, 1},
             VK_FORMAT_R32G32B32A32_SFLOAT,
-            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, false
+            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, false
         );
 
         postProcessImage_ = createImage(
@@ -47,16 +96,49 @@ namespace renderer
             VK_FORMAT_R16G16B16A16_UNORM, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
             VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, false
         );
+        // the AOVs are read back by readOutput()
+        constexpr VkImageUsageFlags aovUsage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        aovImages_.albedo = createImage({swapchainExtent_.width, swapchainExtent_.height, 1},
+                                        VK_FORMAT_R16G16B16A16_SFLOAT, aovUsage, false);
+        // 32 bits for the depth
+        aovImages_.normalDepth = createImage({swapchainExtent_.width, swapchainExtent_.height, 1},
+                                             VK_FORMAT_R32G32B32A32_SFLOAT, aovUsage, false);
+        // rgba since two channel integer storage images need an optional feature
+        aovImages_.ids = createImage({swapchainExtent_.width, swapchainExtent_.height, 1},
+                                     VK_FORMAT_R32G32B32A32_UINT, aovUsage, false);
+        for (auto& image : filterImages_)
+        {
+            image = createImage({swapchainExtent_.width, swapchainExtent_.height, 1}, VK_FORMAT_R32G32B32A32_SFLOAT,
+                                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, false);
+        }
+        historyImages_.radiance = createImage({swapchainExtent_.width, swapchainExtent_.height, 1},
+                                              VK_FORMAT_R32G32B32A32_SFLOAT,
+                                              VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, false);
+        historyImages_.normalDepth = createImage({swapchainExtent_.width, swapchainExtent_.height, 1},
+                                                 VK_FORMAT_R32G32B32A32_SFLOAT,
+                                                 VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, false);
         deletionQueue_.push_function([=]()
         {
             destroyImage(drawImage_);
             destroyImage(postProcessImage_);
+            destroyImage(aovImages_.albedo);
+            destroyImage(aovImages_.normalDepth);
+            destroyImage(aovImages_.ids);
+            for (const auto& image : filterImages_)
+                destroyImage(image);
+            destroyImage(historyImages_.radiance);
+            destroyImage(historyImages_.normalDepth);
         });
 
         initGlobalResources();
         initPathTracing();
+        initDenoising();
+        initReprojection();
         initPostProcessing();
         initEquiToCubeMap();
+        createPipelineCache();
+        createPipelines();
     }
 
 
@@ -66,10 +148,14 @@ namespace renderer
         createInstance(window);
         pickPhysicalDevice();
         createLogicaldevice();
-        createSwapchain(window);
+        if (!headless_)
+            createSwapchain(window);
         createVmaAllocator();
         createCommands();
         createSyncs();
+        createTimestampQueries();
+        createUploadManager();
+        initSceneHeap();
     }
 
     void Renderer::createInstance(GLFWwindow* window)
@@ -87,8 +173,9 @@ namespace renderer
             .apiVersion = VK_API_VERSION_1_3
         };
 
+        // no surface to create without a window
         uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        const char** glfwExtensions = headless_ ? nullptr : glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
 
         VkInstanceCreateInfo createInfo{
@@ -107,7 +194,11 @@ namespace renderer
 
 
         VK_CHECK(vkCreateInstance(&createInfo, nullptr, &instance_), "Failed to create instance !");
-        VK_CHECK(glfwCreateWindowSurface(instance_, window, nullptr, &surface_), "failed to create window surface!");
+        if (!headless_)
+        {
+            VK_CHECK(glfwCreateWindowSurface(instance_, window, nullptr, &surface_),
+                     "failed to create window surface!");
+        }
 
         deletionQueue_.push_function([=]()
         {
@@ -121,19 +212,25 @@ namespace renderer
         VkPhysicalDeviceProperties deviceProperties;
         vkGetPhysicalDeviceProperties(device, &deviceProperties);
 
-        const bool discrete = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
-        const bool extensionsSupported = vk_utils::checkDeviceExtensionSupport(device);
+        VkPhysicalDeviceFeatures deviceFeatures;
+        vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+
+        // the scene heap offsets are 64 bit
+        const bool int64Supported = deviceFeatures.shaderInt64;
+        const bool extensionsSupported = vk_utils::checkDeviceExtensionSupport(device, requiredDeviceExtensions());
+        // optional, the software BVH is used without it
+        rayQuerySupported_ = extensionsSupported && vk_utils::isRayQuerySupported(device);
         findQueueFamily(device);
         const bool hasNecessaryQueueFamilies = queueFamily_.has_value();
-        bool swapchainAdequate = false;
-        if (extensionsSupported)
+        bool swapchainAdequate = headless_;
+        if (extensionsSupported && !headless_)
         {
             vk_utils::SwapchainSupportDetails swapchainSupport = vk_utils::querySwapchainSupport(
                 device, surface_);
             swapchainAdequate = !swapchainSupport.formats.empty() && !swapchainSupport.presentModes.empty();
         }
 
-        return discrete && hasNecessaryQueueFamilies && extensionsSupported && swapchainAdequate;
+        return int64Supported && hasNecessaryQueueFamilies && extensionsSupported && swapchainAdequate;
     }
 
     void Renderer::findQueueFamily(VkPhysicalDevice device)
@@ -145,15 +242,26 @@ namespace renderer
         vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
         int i = 0;
+        transferQueueFamily_.reset();
         for (const auto& queueFamily : queueFamilies)
         {
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+            VkBool32 presentSupport = headless_;
+            if (!headless_)
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
             if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT &&
                 presentSupport)
             {
                 queueFamily_ = i;
             }
+
+            // A transfer only family is usually backed by the DMA engines, banded image copies need a 1x1x1 granularity
+            const VkExtent3D granularity = queueFamily.minImageTransferGranularity;
+            if (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT &&
+                !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+                granularity.width == 1 && granularity.height == 1 && granularity.depth == 1)
+            {
+                transferQueueFamily_ = i;
+            }
             i++;
         }
         if (!queueFamily_.has_value())
@@ -173,6 +281,16 @@ namespace renderer
         std::vector<VkPhysicalDevice> devices(deviceCount);
         vkEnumeratePhysicalDevices(instance_, &deviceCount, devices.data());
 
+        // Discrete GPUs first, integrated ones and CPU implementations such as lavapipe are the fallback.
+        // isDeviceSuitable() records the queue families and capabilities of the device it looked at last.
+        auto isDiscrete = [](VkPhysicalDevice device)
+        {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(device, &properties);
+            return properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+        };
+        std::ranges::stable_partition(devices, isDiscrete);
+
         for (const auto& device : devices)
         {
             if (isDeviceSuitable(device))
@@ -188,9 +306,25 @@ namespace renderer
         }
     }
 
+    std::vector<const char*> Renderer::requiredDeviceExtensions() const
+    {
+        std::vector<const char*> extensions(DEVICE_EXTENSIONS.begin(), DEVICE_EXTENSIONS.end());
+        // nothing is presented without a window, software implementations may not offer a swap chain at all
+        if (headless_)
+        {
+            std::erase_if(extensions, [](const char* name)
+            {
+                return std::string_view(name) == VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+            });
+        }
+        return extensions;
+    }
+
     void Renderer::createLogicaldevice()
     {
-        VkPhysicalDeviceFeatures deviceFeatures = {};
+        VkPhysicalDeviceFeatures deviceFeatures = {
+            .shaderInt64 = VK_TRUE,
+        };
         VkPhysicalDeviceSynchronization2Features sync2Feature = {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
             .synchronization2 = VK_TRUE
@@ -204,27 +338,60 @@ namespace renderer
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
             .pNext = &dynRendFeature,
             .descriptorIndexing = VK_TRUE,
+            .descriptorBindingUpdateUnusedWhilePending = VK_TRUE,
             .descriptorBindingPartiallyBound = VK_TRUE,
             .descriptorBindingVariableDescriptorCount = VK_TRUE,
             .runtimeDescriptorArray = VK_TRUE,
+            .timelineSemaphore = VK_TRUE,
             .bufferDeviceAddress = VK_TRUE,
         };
 
         float queuePriority = 1.0f;
-        VkDeviceQueueCreateInfo queueCreateInfo = {
-            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-            .queueFamilyIndex = queueFamily_.value(),
-            .queueCount = 1,
-            .pQueuePriorities = &queuePriority,
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos = {
+            {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = queueFamily_.value(),
+                .queueCount = 1,
+                .pQueuePriorities = &queuePriority,
+            }
+        };
+        if (transferQueueFamily_.has_value())
+        {
+            queueCreateInfos.push_back({
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = transferQueueFamily_.value(),
+                .queueCount = 1,
+                .pQueuePriorities = &queuePriority,
+            });
+        }
+
+        std::vector<const char*> extensions = requiredDeviceExtensions();
+        memoryBudgetSupported_ = vk_utils::isDeviceExtensionSupported(physicalDevice_,
+                                                                      VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (memoryBudgetSupported_)
+            extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+        VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeature = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
+            .pNext = &features12,
+            .accelerationStructure = VK_TRUE,
         };
+        VkPhysicalDeviceRayQueryFeaturesKHR rayQueryFeature = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR,
+            .pNext = &accelerationStructureFeature,
+            .rayQuery = VK_TRUE,
+        };
+        if (rayQuerySupported_)
+            extensions.insert(extensions.end(), vk_utils::RAY_QUERY_EXTENSIONS.begin(),
+                              vk_utils::RAY_QUERY_EXTENSIONS.end());
 
         VkDeviceCreateInfo deviceCreateInfo = {
             .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-            .pNext = &features12,
-            .queueCreateInfoCount = 1,
-            .pQueueCreateInfos = &queueCreateInfo,
-            .enabledExtensionCount = static_cast<uint32_t>(DEVICE_EXTENSIONS.size()),
-            .ppEnabledExtensionNames = DEVICE_EXTENSIONS.data(),
+            .pNext = rayQuerySupported_ ? static_cast<void*>(&rayQueryFeature) : static_cast<void*>(&features12),
+            .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
+            .pQueueCreateInfos = queueCreateInfos.data(),
+            .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
+            .ppEnabledExtensionNames = extensions.data(),
             .pEnabledFeatures = &deviceFeatures,
         };
 
@@ -241,6 +408,25 @@ namespace renderer
                  "Failed to create logical device!");
 
         vkGetDeviceQueue(device_, queueFamily_.value(), 0, &queue_);
+        // without a dedicated family the uploads go through the main queue
+        transferQueue_ = queue_;
+        if (transferQueueFamily_.has_value())
+            vkGetDeviceQueue(device_, transferQueueFamily_.value(), 0, &transferQueue_);
+
+        if (rayQuerySupported_)
+        {
+            accelerationStructureFunctions_.load(device_);
+            VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR,
+            };
+            VkPhysicalDeviceProperties2 properties = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                .pNext = &accelerationStructureProperties,
+            };
+            vkGetPhysicalDeviceProperties2(physicalDevice_, &properties);
+            scratchAlignment_ = std::max<VkDeviceSize>(
+                accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+        }
 
         deletionQueue_.push_function([=]()
         {
@@ -370,8 +556,12 @@ namespace renderer
 
     void Renderer::createVmaAllocator()
     {
+        VmaAllocatorCreateFlags flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+        // without the extension VMA falls back to an estimate based on its own allocations
+        if (memoryBudgetSupported_)
+            flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
         VmaAllocatorCreateInfo allocatorInfo = {
-            .flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT,
+            .flags = flags,
             .physicalDevice = physicalDevice_,
             .device = device_,
             .instance = instance_,
@@ -469,7 +659,34 @@ namespace renderer
     }
 
 
+    void Renderer::createUploadManager()
+    {
+        uploadManager_.init(device_, allocator_, transferQueue_, transferQueueFamily_.value_or(queueFamily_.value()),
+                            queueFamily_.value());
+        deletionQueue_.push_function([=]()
+        {
+            uploadManager_.cleanup();
+        });
+    }
+
+
     // IMGUI
+    void Renderer::initSceneHeap()
+    {
+        growSceneHeap(INITIAL_SCENE_HEAP_SIZE);
+        // the sampler tables do not depend on the scene, every header points to the same range
+        const std::vector<uint32_t> sobolMatrices = path_tracing::buildSobolMatrices();
+        sceneSobolRange_ = uploadSceneRange(sobolMatrices.data(), sobolMatrices.size() * sizeof(uint32_t),
+                                            sizeof(uint32_t));
+        // an empty scene is committed by the first frame
+        sceneDirty_ = true;
+
+        deletionQueue_.push_function([=]()
+        {
+            destroyBuffer(sceneHeap_.buffer);
+        });
+    }
+
     void Renderer::initImguiBackend(GLFWwindow* wwindow)
     {
         VkDescriptorPoolSize poolSizes[] = {
@@ -527,8 +744,12 @@ namespace renderer
     void Renderer::initGlobalResources()
     {
         // GLO-Resources
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+        const VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+        globalResources_.cameraStride = (sizeof(CameraUniform) + alignment - 1) / alignment * alignment;
         globalResources_.buffer = createBuffer(
-            sizeof(CameraUniform),
+            globalResources_.cameraStride * FRAME_OVERLAP,
             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
             VMA_MEMORY_USAGE_CPU_TO_GPU
         );
@@ -542,7 +763,7 @@ namespace renderer
 
         // GLO-Descriptors
         vk_utils::DescriptorLayoutBuilder globalBuilder;
-        globalBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        globalBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
         globalBuilder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
         VkDescriptorBindingFlags bindingFlgas[2] = {0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT};
@@ -553,26 +774,32 @@ namespace renderer
         };
         descriptorLayouts_.global = globalBuilder.
             build(device_, VK_SHADER_STAGE_COMPUTE_BIT, &bindingFlagsInfo);
-        descriptorSets_.glboal = globalDescriptorAllocator_.
-            allocate(device_, descriptorLayouts_.global);
+        // double buffered, a new environment is written into the set the frame in flight does not use
+        for (auto& set : descriptorSets_.glboal)
+            set = globalDescriptorAllocator_.allocate(device_, descriptorLayouts_.global);
 
         VkDescriptorBufferInfo globalBufferInfo = {
             .buffer = globalResources_.buffer.buffer,
             .offset = 0,
-            .range = globalResources_.buffer.allocation->GetSize()
-        };
-        VkWriteDescriptorSet globalBufferWrite = {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = descriptorSets_.glboal,
-            .dstBinding = 0,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .pBufferInfo = &globalBufferInfo,
+            .range = sizeof(CameraUniform)
         };
+        for (const auto& set : descriptorSets_.glboal)
+        {
+            VkWriteDescriptorSet globalBufferWrite = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = set,
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                .pBufferInfo = &globalBufferInfo,
+            };
+            vkUpdateDescriptorSets(device_, 1, &globalBufferWrite, 0, nullptr);
+        }
 
-        vkUpdateDescriptorSets(device_, 1, &globalBufferWrite, 0, nullptr);
         deletionQueue_.push_function([=]()
         {
+            destroyImage(globalResources_.envMap);
+            destroyBuffer(globalResources_.envAliasBuffer);
             destroyBuffer(globalResources_.buffer);
             vkDestroySampler(device_, globalResources_.defaultLinearSampler, nullptr);
             vkDestroyDescriptorSetLayout(device_, descriptorLayouts_.global, nullptr);
@@ -586,10 +813,12 @@ namespace renderer
         // PT-Descriptors
         vk_utils::DescriptorLayoutBuilder builder;
         builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-        builder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 30);
+        builder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_TEXTURES);
 
         VkDescriptorBindingFlags bindingFlgas[2] = {
-            0, VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+            // textures of meshes added at runtime are written while earlier frames are still in flight
+            0, VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT
         };
         VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
@@ -598,7 +827,7 @@ namespace renderer
         };
         descriptorLayouts_.pathTracing = builder.build(device_, VK_SHADER_STAGE_COMPUTE_BIT, &bindingFlagsInfo);
 
-        const uint32_t maxTextureDescCount = 30;
+        const uint32_t maxTextureDescCount = MAX_TEXTURES;
         VkDescriptorSetVariableDescriptorCountAllocateInfo texturesVariableInfo = {
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
             .descriptorSetCount = 1,
@@ -621,19 +850,37 @@ namespace renderer
         };
         vkUpdateDescriptorSets(device_, 1, &drawImageWrite, 0, nullptr);
 
+        // PT-AOVs, also read by the denoiser
+        vk_utils::DescriptorLayoutBuilder aovBuilder;
+        aovBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        aovBuilder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        aovBuilder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        descriptorLayouts_.aovs = aovBuilder.build(device_, VK_SHADER_STAGE_COMPUTE_BIT);
+        descriptorSets_.aovs = globalDescriptorAllocator_.allocate(device_, descriptorLayouts_.aovs);
+
+        VkDescriptorImageInfo aovInfos[3] = {
+            {.imageView = aovImages_.albedo.imageView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+            {.imageView = aovImages_.normalDepth.imageView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+            {.imageView = aovImages_.ids.imageView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+        };
+        VkWriteDescriptorSet aovWrites[3];
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            aovWrites[i] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = descriptorSets_.aovs,
+                .dstBinding = i,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .pImageInfo = &aovInfos[i],
+            };
+        }
+        vkUpdateDescriptorSets(device_, 3, &aovWrites[0], 0, nullptr);
 
-        // PT-Pipeline
-        auto compShaderCode = vk_utils::readFile("./shaders/path_tracing.comp.spv");
-        auto compModule = vk_utils::createShaderModule(device_, compShaderCode);
 
-        VkPipelineShaderStageCreateInfo computeShaderStageInfo = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-            .module = compModule,
-            .pName = "main",
-        };
+        // PT-Pipeline layout, the pipeline itself is created in createPipelines()
         std::vector<VkDescriptorSetLayout> setLayouts = {
-            descriptorLayouts_.global, descriptorLayouts_.pathTracing
+            descriptorLayouts_.global, descriptorLayouts_.pathTracing, descriptorLayouts_.aovs
         };
 
         VkPushConstantRange constantRange = {
@@ -643,7 +890,7 @@ namespace renderer
         };
         VkPipelineLayoutCreateInfo computePipelineLayoutInfo{
             .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-            .setLayoutCount = 2,
+            .setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
             .pSetLayouts = setLayouts.data(),
             .pushConstantRangeCount = 1,
             .pPushConstantRanges = &constantRange
@@ -653,23 +900,14 @@ namespace renderer
             vkCreatePipelineLayout(device_, &computePipelineLayoutInfo, nullptr, &pipelineLayouts_.pathTracing),
             "Could not create pipeline layout!");
 
-        VkComputePipelineCreateInfo pipelineInfo{
-            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-            .stage = computeShaderStageInfo,
-            .layout = pipelineLayouts_.pathTracing,
-        };
-
-        VK_CHECK(
-            vkCreateComputePipelines(device_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipelines_.pathTracing),
-            "Failed to create compute pipeline!");
-        vkDestroyShaderModule(device_, compModule, nullptr);
-
 
         deletionQueue_.push_function([=]()
         {
-            vkDestroyPipeline(device_, pipelines_.pathTracing, nullptr);
+            for (auto& texture : textures_)
+                destroyImage(texture);
             vkDestroyPipelineLayout(device_, pipelineLayouts_.pathTracing, nullptr);
             vkDestroyDescriptorSetLayout(device_, descriptorLayouts_.pathTracing, nullptr);
+            vkDestroyDescriptorSetLayout(device_, descriptorLayouts_.aovs, nullptr);
             globalDescriptorAllocator_.destroyPool(device_);
         });
     }
@@ -682,6 +920,7 @@ namespace renderer
         vk_utils::DescriptorLayoutBuilder builder;
         builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
         builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        builder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
         descriptorLayouts_.postProcessing = builder.build(device_, VK_SHADER_STAGE_COMPUTE_BIT);
         descriptorSets_.postProcessing = globalDescriptorAllocator_.allocate(
             device_, descriptorLayouts_.postProcessing);
@@ -710,21 +949,24 @@ namespace renderer
             .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
             .pImageInfo = &ppImgInfo,
         };
-        VkWriteDescriptorSet writes[2] = {drawImageWrite, ppImageWrite};
-
-        vkUpdateDescriptorSets(device_, 2, &writes[0], 0, nullptr);
+        VkDescriptorImageInfo denoisedImgInfo = {
+            .imageView = filterImages_[0].imageView,
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+        };
+        VkWriteDescriptorSet denoisedImageWrite = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptorSets_.postProcessing,
+            .dstBinding = 2,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .pImageInfo = &denoisedImgInfo,
+        };
+        VkWriteDescriptorSet writes[3] = {drawImageWrite, ppImageWrite, denoisedImageWrite};
 
-        // PP-Pipeline
-        auto compShaderCode = vk_utils::readFile("./shaders/post_processing.comp.spv");
-        auto compModule = vk_utils::createShaderModule(device_, compShaderCode);
+        vkUpdateDescriptorSets(device_, 3, &writes[0], 0, nullptr);
 
-        VkPipelineShaderStageCreateInfo computeShaderStageInfo = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-            .module = compModule,
-            .pName = "main",
-        };
-        std::vector<VkDescriptorSetLayout> setLayouts = {descriptorLayouts_.postProcessing};
+        // PP-Pipeline layout, the AOVs are displayed straight from the set of the path tracer
+        std::vector<VkDescriptorSetLayout> setLayouts = {descriptorLayouts_.postProcessing, descriptorLayouts_.aovs};
 
         VkPushConstantRange constantRange = {
             .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
@@ -734,7 +976,7 @@ namespace renderer
 
         VkPipelineLayoutCreateInfo computePipelineLayoutInfo{
             .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-            .setLayoutCount = 1,
+            .setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
             .pSetLayouts = setLayouts.data(),
             .pushConstantRangeCount = 1,
             .pPushConstantRanges = &constantRange
@@ -744,22 +986,144 @@ namespace renderer
             vkCreatePipelineLayout(device_, &computePipelineLayoutInfo, nullptr, &pipelineLayouts_.postProcessing),
             "Could not create post processing pipeline layout!");
 
-        VkComputePipelineCreateInfo pipelineInfo{
-            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-            .stage = computeShaderStageInfo,
-            .layout = pipelineLayouts_.postProcessing,
+        deletionQueue_.push_function([=]()
+        {
+            vkDestroyPipeline(device_, pipelines_.postProcessing, nullptr);
+            vkDestroyPipelineLayout(device_, pipelineLayouts_.postProcessing, nullptr);
+            vkDestroyDescriptorSetLayout(device_, descriptorLayouts_.postProcessing, nullptr);
+        });
+    }
+
+
+    // DENOISING INITIALIZATION
+    void Renderer::initDenoising()
+    {
+        // DN-Descriptors, the AOVs come from the set of the path tracer
+        vk_utils::DescriptorLayoutBuilder builder;
+        builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, static_cast<uint32_t>(filterImages_.size()));
+        descriptorLayouts_.denoising = builder.build(device_, VK_SHADER_STAGE_COMPUTE_BIT);
+        descriptorSets_.denoising = globalDescriptorAllocator_.allocate(device_, descriptorLayouts_.denoising);
+
+        VkDescriptorImageInfo drawImgInfo = {
+            .imageView = drawImage_.imageView,
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+        };
+        std::array<VkDescriptorImageInfo, 2> filterImgInfos;
+        for (size_t i = 0; i < filterImages_.size(); i++)
+            filterImgInfos[i] = {.imageView = filterImages_[i].imageView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+        VkWriteDescriptorSet writes[2] = {
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = descriptorSets_.denoising,
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .pImageInfo = &drawImgInfo,
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = descriptorSets_.denoising,
+                .dstBinding = 1,
+                .descriptorCount = static_cast<uint32_t>(filterImgInfos.size()),
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .pImageInfo = filterImgInfos.data(),
+            },
+        };
+        vkUpdateDescriptorSets(device_, 2, &writes[0], 0, nullptr);
+
+        // DN-Pipeline layout
+        std::vector<VkDescriptorSetLayout> setLayouts = {descriptorLayouts_.denoising, descriptorLayouts_.aovs};
+
+        VkPushConstantRange constantRange = {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(DenoisingPushConstants)
+        };
+
+        VkPipelineLayoutCreateInfo computePipelineLayoutInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
+            .pSetLayouts = setLayouts.data(),
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &constantRange
         };
 
         VK_CHECK(
-            vkCreateComputePipelines(device_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipelines_.postProcessing),
-            "Failed to create post processing compute pipeline!");
-        vkDestroyShaderModule(device_, compModule, nullptr);
+            vkCreatePipelineLayout(device_, &computePipelineLayoutInfo, nullptr, &pipelineLayouts_.denoising),
+            "Could not create denoising pipeline layout!");
 
         deletionQueue_.push_function([=]()
         {
-            vkDestroyPipeline(device_, pipelines_.postProcessing, nullptr);
-            vkDestroyPipelineLayout(device_, pipelineLayouts_.postProcessing, nullptr);
-            vkDestroyDescriptorSetLayout(device_, descriptorLayouts_.postProcessing, nullptr);
+            vkDestroyPipeline(device_, pipelines_.denoising, nullptr);
+            vkDestroyPipelineLayout(device_, pipelineLayouts_.denoising, nullptr);
+            vkDestroyDescriptorSetLayout(device_, descriptorLayouts_.denoising, nullptr);
+        });
+    }
+
+
+    // REPROJECTION INITIALIZATION
+    void Renderer::initReprojection()
+    {
+        // RP-Descriptors, the camera comes from the global set and the current first hits from the AOV set
+        vk_utils::DescriptorLayoutBuilder builder;
+        builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        builder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        descriptorLayouts_.reprojection = builder.build(device_, VK_SHADER_STAGE_COMPUTE_BIT);
+        descriptorSets_.reprojection = globalDescriptorAllocator_.allocate(device_, descriptorLayouts_.reprojection);
+
+        std::array<VkDescriptorImageInfo, 3> imgInfos = {
+            VkDescriptorImageInfo{.imageView = drawImage_.imageView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+            VkDescriptorImageInfo{
+                .imageView = historyImages_.radiance.imageView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+            },
+            VkDescriptorImageInfo{
+                .imageView = historyImages_.normalDepth.imageView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+            },
+        };
+        std::array<VkWriteDescriptorSet, 3> writes;
+        for (uint32_t i = 0; i < writes.size(); i++)
+        {
+            writes[i] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = descriptorSets_.reprojection,
+                .dstBinding = i,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .pImageInfo = &imgInfos[i],
+            };
+        }
+        vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+        // RP-Pipeline layout
+        std::vector<VkDescriptorSetLayout> setLayouts = {
+            descriptorLayouts_.global, descriptorLayouts_.reprojection, descriptorLayouts_.aovs
+        };
+
+        VkPushConstantRange constantRange = {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(ReprojectionPushConstants)
+        };
+
+        VkPipelineLayoutCreateInfo computePipelineLayoutInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
+            .pSetLayouts = setLayouts.data(),
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &constantRange
+        };
+
+        VK_CHECK(
+            vkCreatePipelineLayout(device_, &computePipelineLayoutInfo, nullptr, &pipelineLayouts_.reprojection),
+            "Could not create reprojection pipeline layout!");
+
+        deletionQueue_.push_function([=]()
+        {
+            vkDestroyPipeline(device_, pipelines_.reprojection, nullptr);
+            vkDestroyPipelineLayout(device_, pipelineLayouts_.reprojection, nullptr);
+            vkDestroyDescriptorSetLayout(device_, descriptorLayouts_.reprojection, nullptr);
         });
     }
 
@@ -780,20 +1144,11 @@ namespace renderer
             .pBindingFlags = bindingFlgas
         };
         descriptorLayouts_.cubemapCreation = builder.build(device_, VK_SHADER_STAGE_COMPUTE_BIT, &bindingFlagsInfo);
-        descriptorSets_.cubemapCreation = globalDescriptorAllocator_.allocate(
-            device_, descriptorLayouts_.cubemapCreation);
-
+        for (auto& set : descriptorSets_.cubemapCreation)
+            set = globalDescriptorAllocator_.allocate(device_, descriptorLayouts_.cubemapCreation);
 
-        // CU-Pipeline
-        auto compShaderCode = vk_utils::readFile("./shaders/equirectangular_to_cubemap.comp.spv");
-        auto compModule = vk_utils::createShaderModule(device_, compShaderCode);
 
-        VkPipelineShaderStageCreateInfo computeShaderStageInfo = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-            .module = compModule,
-            .pName = "main",
-        };
+        // CU-Pipeline layout
         VkPipelineLayoutCreateInfo computePipelineLayoutInfo{
             .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
             .setLayoutCount = 1,
@@ -804,49 +1159,205 @@ namespace renderer
             vkCreatePipelineLayout(device_, &computePipelineLayoutInfo, nullptr, &pipelineLayouts_.cubemapCreation),
             "Could not create cube map pipeline layout!");
 
+        deletionQueue_.push_function([=]()
+        {
+            vkDestroyPipeline(device_, pipelines_.cubemapCreation, nullptr);
+            vkDestroyPipelineLayout(device_, pipelineLayouts_.cubemapCreation, nullptr);
+            vkDestroyDescriptorSetLayout(device_, descriptorLayouts_.cubemapCreation, nullptr);
+        });
+    }
+
+
+    // PIPELINES
+    void Renderer::createPipelineCache()
+    {
+        pipelineCache_ = vk_utils::loadPipelineCache(device_, physicalDevice_, PIPELINE_CACHE_DIRECTORY);
+        deletionQueue_.push_function([=]()
+        {
+            // written on shutdown so that pipelines created at runtime are kept as well
+            vk_utils::savePipelineCache(device_, physicalDevice_, pipelineCache_, PIPELINE_CACHE_DIRECTORY);
+            vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
+        });
+    }
+
+    VkPipeline Renderer::createComputePipeline(const std::string& shaderPath, VkPipelineLayout layout,
+                                               const VkSpecializationInfo* specialization) const
+    {
+        auto compShaderCode = vk_utils::readFile(shaderPath);
+        auto compModule = vk_utils::createShaderModule(device_, compShaderCode);
+
         VkComputePipelineCreateInfo pipelineInfo{
             .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-            .stage = computeShaderStageInfo,
-            .layout = pipelineLayouts_.cubemapCreation,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = compModule,
+                .pName = "main",
+                .pSpecializationInfo = specialization,
+            },
+            .layout = layout,
         };
 
-        VK_CHECK(
-            vkCreateComputePipelines(device_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipelines_.cubemapCreation),
-            "Failed to create cube map compute pipeline!");
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        const VkResult result = vkCreateComputePipelines(device_, pipelineCache_, 1, &pipelineInfo, nullptr,
+                                                         &pipeline);
         vkDestroyShaderModule(device_, compModule, nullptr);
+        VK_CHECK(result, "Failed to create compute pipeline!");
+        return pipeline;
+    }
+
+    VkPipeline Renderer::createPathTracingPipeline(path_tracing::ShaderVariant variant) const
+    {
+        std::array<VkSpecializationMapEntry, 6> entries;
+        for (uint32_t i = 0; i < entries.size(); i++)
+            entries[i] = {.constantID = i, .offset = i * 4, .size = 4};
+        static_assert(offsetof(path_tracing::ShaderVariant, rayQuery) == 4 * entries.size());
+
+        VkSpecializationInfo specialization = {
+            .mapEntryCount = static_cast<uint32_t>(entries.size()),
+            .pMapEntries = entries.data(),
+            .dataSize = sizeof(path_tracing::ShaderVariant),
+            .pData = &variant,
+        };
+        // the same source compiled with RAY_QUERY defined
+        const char* path = variant.rayQuery
+                               ? "./shaders/path_tracing_ray_query.comp.spv"
+                               : "./shaders/path_tracing.comp.spv";
+        return createComputePipeline(path, pipelineLayouts_.pathTracing, &specialization);
+    }
+
+    void Renderer::createPipelines()
+    {
+        // Pipeline creation is where the driver compiles the shaders, path_tracing.comp alone takes most of the
+        // startup time on a cold cache. The pipeline cache is internally synchronized so they are built side by side.
+        // The path tracer starts out with the generic variant, specialized ones are compiled on demand.
+        const path_tracing::ShaderVariant generic = {.rayQuery = useRayQuery() ? VK_TRUE : VK_FALSE};
+        auto pathTracing = std::async(std::launch::async, &Renderer::createPathTracingPipeline, this, generic);
+        auto postProcessing = std::async(std::launch::async, &Renderer::createComputePipeline, this,
+                                         "./shaders/post_processing.comp.spv", pipelineLayouts_.postProcessing,
+                                         nullptr);
+        auto denoising = std::async(std::launch::async, &Renderer::createComputePipeline, this,
+                                    "./shaders/denoising.comp.spv", pipelineLayouts_.denoising, nullptr);
+        auto reprojection = std::async(std::launch::async, &Renderer::createComputePipeline, this,
+                                       "./shaders/reprojection.comp.spv", pipelineLayouts_.reprojection, nullptr);
+        pipelines_.cubemapCreation = createComputePipeline("./shaders/equirectangular_to_cubemap.comp.spv",
+                                                           pipelineLayouts_.cubemapCreation);
+        pipelines_.postProcessing = postProcessing.get();
+        pipelines_.denoising = denoising.get();
+        pipelines_.reprojection = reprojection.get();
+        pathTracingVariants_[generic] = pathTracing.get();
 
         deletionQueue_.push_function([=]()
         {
-            vkDestroyPipeline(device_, pipelines_.cubemapCreation, nullptr);
-            vkDestroyPipelineLayout(device_, pipelineLayouts_.cubemapCreation, nullptr);
-            vkDestroyDescriptorSetLayout(device_, descriptorLayouts_.cubemapCreation, nullptr);
+            if (pendingPathTracingVariant_.has_value())
+                vkDestroyPipeline(device_, pendingPathTracingVariant_->pipeline.get(), nullptr);
+            for (const auto& [variant, pipeline] : pathTracingVariants_)
+                vkDestroyPipeline(device_, pipeline, nullptr);
         });
     }
 
+    path_tracing::ShaderVariant Renderer::currentShaderVariant(path_tracing::PathTracingKernel kernel) const
+    {
+        path_tracing::ShaderVariant variant = {
+            .brdfDebugging = brdfDebugging_ ? VK_TRUE : VK_FALSE,
+            .kernel = kernel,
+            .rayQuery = useRayQuery() ? VK_TRUE : VK_FALSE,
+        };
+        if (!specializeShaders_)
+            return variant;
+
+        variant.bounces = static_cast<int32_t>(ptPushConstants_.bounces);
+        variant.smoothShading = static_cast<int32_t>(ptPushConstants_.smoothShading);
+        variant.envMapVisible = static_cast<int32_t>(ptPushConstants_.envMapVisible);
+        variant.normalMaps = std::ranges::any_of(sceneMeshes_, [](const auto& mesh) { return mesh.second.normalMapped; })
+                                 ? VK_TRUE
+                                 : VK_FALSE;
+        return variant;
+    }
+
+    VkPipeline Renderer::pathTracingPipeline(path_tracing::PathTracingKernel kernel)
+    {
+        if (pendingPathTracingVariant_.has_value() &&
+            pendingPathTracingVariant_->pipeline.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            pathTracingVariants_[pendingPathTracingVariant_->variant] = pendingPathTracingVariant_->pipeline.get();
+            pendingPathTracingVariant_.reset();
+        }
+
+        const path_tracing::ShaderVariant variant = currentShaderVariant(kernel);
+        if (auto it = pathTracingVariants_.find(variant); it != pathTracingVariants_.end())
+            return it->second;
+
+        // Compiled in the background one at a time, a variant that is no longer wanted once done just stays cached
+        if (!pendingPathTracingVariant_.has_value())
+        {
+            pendingPathTracingVariant_ = PendingShaderVariant{
+                .variant = variant,
+                .pipeline = std::async(std::launch::async, &Renderer::createPathTracingPipeline, this, variant),
+            };
+        }
+
+        // Until then the generic variant gives the same image. Only the debug path changes the result, its generic
+        // variant is compiled right away.
+        const path_tracing::ShaderVariant fallback = {
+            .brdfDebugging = variant.brdfDebugging, .kernel = kernel, .rayQuery = variant.rayQuery
+        };
+        auto it = pathTracingVariants_.find(fallback);
+        if (it == pathTracingVariants_.end())
+            it = pathTracingVariants_.emplace(fallback, createPathTracingPipeline(fallback)).first;
+        return it->second;
+    }
+
 
     // DATA UPLOAD
     void Renderer::uploadEnvMap(const std::string& path)
     {
-        if (globalResources_.envMap.image != VK_NULL_HANDLE)
+        if (pendingEnvironment_.has_value())
+            destroyEnvironment(pendingEnvironment_.value());
+        // swapped in at the start of the next frame, which waits for the uploads
+        pendingEnvironment_ = createEnvironment(path_tracing::loadEnvironment(path));
+        uploadWaitValue_ = uploadManager_.flush();
+    }
+
+    void Renderer::useResidentEnvironment(const std::string& path)
+    {
+        auto it = residentEnvironments_.find(path);
+        if (it == residentEnvironments_.end())
         {
-            destroyImage(globalResources_.envMap);
+            it = residentEnvironments_.emplace(path, createEnvironment(path_tracing::loadEnvironment(path))).first;
+            uploadWaitValue_ = uploadManager_.flush();
         }
+        if (pendingEnvironment_.has_value())
+            destroyEnvironment(pendingEnvironment_.value());
+        pendingEnvironment_.reset();
+        if (globalResources_.envMap.image != it->second.cubeMap.image)
+            pendingEnvironment_ = it->second;
+    }
+
+    bool Renderer::isResidentEnvironment(VkImage cubeMap) const
+    {
+        return std::ranges::any_of(residentEnvironments_, [cubeMap](const auto& entry)
+        {
+            return entry.second.cubeMap.image == cubeMap;
+        });
+    }
 
-        // Equirectangular image (HDR)
-        VkExtent3D equirectangularSize = {1, 1, 1};
-        constexpr VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    Renderer::Environment Renderer::createEnvironment(const path_tracing::EnvironmentData& data)
+    {
+        Environment environment;
 
-        float* textureData = vk_utils::loadHDRTextureData(path, equirectangularSize);
+        // Equirectangular image (HDR), kept as shared exponent texels (4 bytes instead of 16)
+        constexpr VkFormat format = VK_FORMAT_E5B9G9R9_UFLOAT_PACK32;
 
-        AllocatedImage equirectangular{};
+        AllocatedImage& equirectangular = environment.equirectangular;
         equirectangular.imageFormat = format;
-        equirectangular.imageExtent = equirectangularSize;
+        equirectangular.imageExtent = data.size;
 
         VkImageCreateInfo equiCreateInfo = vk_utils::imageCreateInfo(format,
                                                                      VK_IMAGE_USAGE_SAMPLED_BIT |
                                                                      VK_IMAGE_USAGE_TRANSFER_DST_BIT |
                                                                      VK_IMAGE_USAGE_TRANSFER_SRC_BIT
-                                                                     , equirectangularSize);
+                                                                     , data.size);
 
         VmaAllocationCreateInfo allocinfo = {};
         allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -861,298 +1372,821 @@ namespace renderer
         VK_CHECK(vkCreateImageView(device_, &equiViewCreateInfo, nullptr, &equirectangular.imageView),
                  "Could not create equirectangular image view!");
 
-        const size_t dataSize = equirectangularSize.width * equirectangularSize.height * 4 * sizeof(float);
-        AllocatedBuffer stagingBuffer = createBuffer(dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                                     VMA_MEMORY_USAGE_CPU_TO_GPU);
-        memcpy(stagingBuffer.info.pMappedData, textureData, dataSize);
-
-        vk_utils::freeImageData(textureData);
-
-        immediateSubmit([&](VkCommandBuffer cmd)
-        {
-            vk_utils::transitionImage(cmd, equirectangular.image, VK_IMAGE_LAYOUT_UNDEFINED,
-                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-            // Copy buffer data into the image
-
-            VkBufferImageCopy copyRegion = {
-                .bufferOffset = 0,
-                .bufferRowLength = 0,
-                .bufferImageHeight = 0,
-                .imageExtent = equirectangularSize
-            };
-            copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            copyRegion.imageSubresource.mipLevel = 0;
-            copyRegion.imageSubresource.baseArrayLayer = 0;
-            copyRegion.imageSubresource.layerCount = 1;
-
-            vkCmdCopyBufferToImage(cmd, stagingBuffer.buffer, equirectangular.image,
-                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                                   &copyRegion);
-
-            vk_utils::transitionImage(cmd, equirectangular.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                      VK_IMAGE_LAYOUT_GENERAL);
-        });
-        destroyBuffer(stagingBuffer);
-
+        // Luminance based alias table used to sample the environment explicitly
+        const size_t aliasTableSize = data.aliasTable.size() * sizeof(path_tracing::AliasEntry);
+        environment.aliasBuffer = createBuffer(aliasTableSize,
+                                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                               VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                               VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                               VMA_MEMORY_USAGE_GPU_ONLY);
+        VkBufferDeviceAddressInfo aliasAddressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = environment.aliasBuffer.buffer
+        };
+        environment.aliasAddress = vkGetBufferDeviceAddress(device_, &aliasAddressInfo);
+        environment.samplingWidth = data.samplingWidth;
+        environment.samplingHeight = data.samplingHeight;
+
+        // Both copies go through the transfer queue, nothing waits for them here
+        uploadManager_.uploadImage(equirectangular.image, data.size, sizeof(uint32_t), data.texels.data(),
+                                   VK_IMAGE_LAYOUT_GENERAL);
+        uploadManager_.uploadBuffer(environment.aliasBuffer.buffer, 0, data.aliasTable.data(), aliasTableSize);
+
+        // Cubemap image (6 layers), filled from the equirectangular image once the environment is applied
+        VkExtent3D cubeMapSize = {CUBE_MAP_WIDTH, CUBE_MAP_WIDTH, 1};
+        environment.cubeMap = createCubemap(cubeMapSize, CUBE_MAP_FORMAT,
+                                            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+        return environment;
+    }
 
-        // Cubemap image (6 layers)
-        constexpr uint32_t cubeMapWidth = 512;
-        VkExtent3D cubeMapSize = {cubeMapWidth, cubeMapWidth, 1};
-        globalResources_.envMap = createCubemap(cubeMapSize, format,
-                                                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+    void Renderer::applyEnvironment(const Environment& environment)
+    {
+        // the frame in flight uses the other set, writing this one is safe
+        const uint32_t next = (activeEnvironment_ + 1) % 2;
+        // resident environments applied before only need the descriptor
+        const bool converted = environment.equirectangular.image == VK_NULL_HANDLE;
 
         // Update cubemap creation descriptor set
         VkDescriptorImageInfo equiInfo = {
             .sampler = globalResources_.defaultLinearSampler,
-            .imageView = equirectangular.imageView,
+            .imageView = environment.equirectangular.imageView,
             .imageLayout = VK_IMAGE_LAYOUT_GENERAL
         };
         VkWriteDescriptorSet equiWriteInfo = {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = descriptorSets_.cubemapCreation,
+            .dstSet = descriptorSets_.cubemapCreation[next],
             .dstBinding = 0,
             .descriptorCount = 1,
             .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
             .pImageInfo = &equiInfo
         };
         VkDescriptorImageInfo cubeMapInfo = {
-            .imageView = globalResources_.envMap.imageView,
+            .imageView = environment.cubeMap.imageView,
             .imageLayout = VK_IMAGE_LAYOUT_GENERAL
         };
         VkWriteDescriptorSet cubeMapWriteInfo = {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = descriptorSets_.cubemapCreation,
+            .dstSet = descriptorSets_.cubemapCreation[next],
             .dstBinding = 1,
             .descriptorCount = 1,
             .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
             .pImageInfo = &cubeMapInfo
         };
-        VkWriteDescriptorSet writes[2] = {equiWriteInfo, cubeMapWriteInfo};
-        vkUpdateDescriptorSets(device_, 2, &writes[0], 0, nullptr);
-
-
-        // Transform equirectangular to cube map
-        immediateSubmit([&](VkCommandBuffer cmd)
-        {
-            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_.cubemapCreation);
-            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts_.cubemapCreation, 0, 1,
-                                    &descriptorSets_.cubemapCreation, 0, nullptr);
-            vkCmdDispatch(cmd, std::ceil(cubeMapSize.width / 16.0), std::ceil(cubeMapSize.height / 16.0),
-                          6);
-        });
 
         // Update path tracing creation descriptor set
         VkDescriptorImageInfo cubeMapInfo2 = {
             .sampler = globalResources_.defaultLinearSampler,
-            .imageView = globalResources_.envMap.imageView,
+            .imageView = environment.cubeMap.imageView,
             .imageLayout = VK_IMAGE_LAYOUT_GENERAL
         };
         VkWriteDescriptorSet cubeMapWriteInfo2 = {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = descriptorSets_.glboal,
+            .dstSet = descriptorSets_.glboal[next],
             .dstBinding = 1,
             .descriptorCount = 1,
             .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
             .pImageInfo = &cubeMapInfo2
         };
-        vkUpdateDescriptorSets(device_, 1, &cubeMapWriteInfo2, 0, nullptr);
+        VkWriteDescriptorSet writes[3] = {cubeMapWriteInfo2, equiWriteInfo, cubeMapWriteInfo};
+        vkUpdateDescriptorSets(device_, converted ? 1 : 3, &writes[0], 0, nullptr);
 
-        destroyImage(equirectangular);
-        deletionQueue_.push_function([=]()
-        {
-            destroyImage(globalResources_.envMap);
-        });
-    }
 
-    void Renderer::uploadPathTracingScene(const std::vector<path_tracing::Mesh>& scene)
+        // Transform equirectangular to cube map, recorded before the path tracing dispatch of this frame
+        if (!converted)
+        {
+            const AllocatedImage envMap = environment.cubeMap;
+            const AllocatedImage equirectangular = environment.equirectangular;
+            const VkDescriptorSet cubemapCreationSet = descriptorSets_.cubemapCreation[next];
+            pendingGraphicsWork_.push_back([=](VkCommandBuffer cmd)
+            {
+                vk_utils::transitionCubemap(cmd, envMap.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_.cubemapCreation);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts_.cubemapCreation, 0, 1,
+                                        &cubemapCreationSet, 0, nullptr);
+                vkCmdDispatch(cmd, std::ceil(envMap.imageExtent.width / 16.0),
+                              std::ceil(envMap.imageExtent.height / 16.0), 6);
+                // makes the cube map writes visible to the path tracing dispatch
+                vk_utils::transitionCubemap(cmd, envMap.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+
+                retire([=]()
+                {
+                    destroyImage(equirectangular);
+                });
+            });
+            for (auto& [path, resident] : residentEnvironments_)
+            {
+                if (resident.cubeMap.image == environment.cubeMap.image)
+                    resident.equirectangular = {};
+            }
+        }
+
+        // the previous environment is still sampled by the frame in flight
+        const AllocatedImage oldEnvMap = globalResources_.envMap;
+        const AllocatedBuffer oldAliasBuffer = globalResources_.envAliasBuffer;
+        if (oldEnvMap.image != VK_NULL_HANDLE && !isResidentEnvironment(oldEnvMap.image))
+        {
+            retire([=]()
+            {
+                destroyImage(oldEnvMap);
+                destroyBuffer(oldAliasBuffer);
+            });
+        }
+
+        globalResources_.envMap = environment.cubeMap;
+        globalResources_.envAliasBuffer = environment.aliasBuffer;
+        ptPushConstants_.envAliasBuffer = environment.aliasAddress;
+        ptPushConstants_.envSamplingWidth = environment.samplingWidth;
+        ptPushConstants_.envSamplingHeight = environment.samplingHeight;
+        resetAccumulation();
+        activeEnvironment_ = next;
+    }
+
+    void Renderer::destroyEnvironment(const Environment& environment)
     {
-        if (scene.size() == 0)
+        // only released with the renderer
+        if (isResidentEnvironment(environment.cubeMap.image))
             return;
+        // never applied, but its uploads may still be running
+        retire([=]()
+        {
+            destroyImage(environment.equirectangular);
+            destroyImage(environment.cubeMap);
+            destroyBuffer(environment.aliasBuffer);
+        });
+    }
 
-        // Aggregate scene data to build global buffers
-        std::vector<core::Vertex> sceneVertices;
-        std::vector<path_tracing::Triangle> sceneTriangles;
-        std::vector<path_tracing::BVHNode> sceneNodes;
-        std::vector<path_tracing::GPUMaterial> scenemMterials;
-        std::vector<path_tracing::MeshInfo> sceneMeshInfos;
-
-        std::unordered_map<std::string, path_tracing::TextureIterationSettings> texturePaths;
-        int currentTexIndex = -1;
+    std::vector<MeshHandle> Renderer::uploadPathTracingScene(const std::vector<path_tracing::Mesh>& scene)
+    {
+        clearScene();
 
-        path_tracing::MeshInfo offsets{};
+        VkDeviceSize sceneSize = 0;
+        for (const auto& mesh : scene)
+            sceneSize += geometrySize(mesh.geometry) + sizeof(path_tracing::GPUMaterial);
+        warnIfOverBudget(sceneSize, "uploading the scene");
 
+        std::vector<MeshHandle> handles;
+        handles.reserve(scene.size());
         for (const auto& mesh : scene)
+            handles.push_back(addMesh(mesh));
+        return handles;
+    }
+
+    MeshHandle Renderer::addMesh(const path_tracing::Mesh& mesh)
+    {
+        const MeshHandle handle = nextMeshHandle_++;
+        SceneMesh& sceneMesh = sceneMeshes_[handle];
+        uploadGeometry(sceneMesh, mesh.geometry);
+        uploadMaterial(sceneMesh, mesh.material);
+        sceneDirty_ = true;
+        return handle;
+    }
+
+    void Renderer::replaceMesh(MeshHandle handle, const path_tracing::Mesh& mesh)
+    {
+        SceneMesh& sceneMesh = sceneMeshes_.at(handle);
+        uploadGeometry(sceneMesh, mesh.geometry);
+        uploadMaterial(sceneMesh, mesh.material);
+        sceneDirty_ = true;
+    }
+
+    void Renderer::updateMaterial(MeshHandle handle, const path_tracing::Material& material)
+    {
+        uploadMaterial(sceneMeshes_.at(handle), material);
+        sceneDirty_ = true;
+    }
+
+    void Renderer::removeMesh(MeshHandle handle)
+    {
+        releaseMeshRanges(sceneMeshes_.at(handle));
+        sceneMeshes_.erase(handle);
+        sceneDirty_ = true;
+    }
+
+    void Renderer::clearScene()
+    {
+        while (!sceneMeshes_.empty())
+            removeMesh(sceneMeshes_.begin()->first);
+    }
+
+    std::vector<MeshHandle> Renderer::stageScene(const path_tracing::SceneData& scene)
+    {
+        discardStagedScene();
+        // the current scene stays resident until the swap, so both have to fit
+        warnIfOverBudget(estimateSceneSize(scene), "staging the scene");
+
+        // Uploaded next to the current scene, which keeps rendering until the swap
+        StagedScene staged;
+        std::vector<MeshHandle> handles;
+        handles.reserve(scene.meshes.size());
+        for (const auto& mesh : scene.meshes)
         {
-            sceneVertices.insert(sceneVertices.end(), mesh.geometry.vertices.begin(), mesh.geometry.vertices.end());
-            sceneTriangles.insert(sceneTriangles.end(), mesh.geometry.triangles.begin(),
-                                  mesh.geometry.triangles.end());
-            sceneNodes.insert(sceneNodes.end(), mesh.geometry.nodes.begin(), mesh.geometry.nodes.end());
-
-            path_tracing::GPUMaterial m = {
-                .baseCol = mesh.material.color,
-                .baseColMapIndex = path_tracing::Material::handleMapProperty(mesh.material.colorMap, texturePaths,
-                                                                             currentTexIndex, true),
-                .emissiveStrength = mesh.material.emissiveStrength,
-                .roughness = mesh.material.roughness,
-                .roughnessMapIndex = path_tracing::Material::handleMapProperty(mesh.material.roughnessMap, texturePaths,
-                                                                               currentTexIndex),
-                .metallic = mesh.material.metallic,
-                .metallicMapIndex = path_tracing::Material::handleMapProperty(mesh.material.metallicMap, texturePaths,
-                                                                              currentTexIndex),
-                .normalMapIndex = path_tracing::Material::handleMapProperty(mesh.material.normalMap, texturePaths,
-                                                               currentTexIndex),
-            };
-            scenemMterials.push_back(m);
-            sceneMeshInfos.push_back(offsets);
+            const MeshHandle handle = nextMeshHandle_++;
+            SceneMesh& sceneMesh = staged.meshes[handle];
+            uploadGeometry(sceneMesh, mesh.geometry);
+            uploadMaterial(sceneMesh, mesh.material, &scene.textures);
+            handles.push_back(handle);
+        }
+        if (scene.environment.has_value())
+            staged.environment = createEnvironment(scene.environment.value());
+
+        staged.uploadValue = uploadManager_.flush();
+        stagedScene_ = std::move(staged);
+        return handles;
+    }
+
+    void Renderer::discardStagedScene()
+    {
+        if (!stagedScene_.has_value())
+            return;
+
+        for (const auto& [handle, sceneMesh] : stagedScene_->meshes)
+            releaseMeshRanges(sceneMesh);
+        if (stagedScene_->environment.has_value())
+            destroyEnvironment(stagedScene_->environment.value());
+        stagedScene_.reset();
+    }
+
+    void Renderer::swapStagedScene()
+    {
+        // the current meshes are retired like any removal, the frames in flight keep reading them
+        clearScene();
+        sceneMeshes_ = std::move(stagedScene_->meshes);
+        sceneDirty_ = true;
 
-            offsets.vertexOffset += mesh.geometry.vertices.size();
-            offsets.triangleOffset += mesh.geometry.triangles.size();
-            offsets.nodeOffset += mesh.geometry.nodes.size();
-            offsets.materialIndex++;
+        if (stagedScene_->environment.has_value())
+        {
+            if (pendingEnvironment_.has_value())
+                destroyEnvironment(pendingEnvironment_.value());
+            pendingEnvironment_ = stagedScene_->environment;
         }
 
-        // Calculate buffer sizes
-        const size_t vertexBufferSize = sceneVertices.size() * sizeof(core::Vertex);
-        const size_t triangleBufferSize = sceneTriangles.size() * sizeof(path_tracing::Triangle);
-        const size_t nodeBufferSize = sceneNodes.size() * sizeof(path_tracing::BVHNode);
-        const size_t materialBufferSize = scenemMterials.size() * sizeof(path_tracing::GPUMaterial);
-        const size_t meshInfoBufferSize = sceneMeshInfos.size() * sizeof(path_tracing::MeshInfo);
+        // already complete, this only lets the frame acquire the staged resources
+        uploadWaitValue_ = std::max(uploadWaitValue_, stagedScene_->uploadValue);
+        stagedScene_.reset();
+
+        logMemoryReport();
+    }
 
-        path_tracing::SceneBuffers newScene;
+    VkDeviceSize Renderer::geometrySize(const path_tracing::Geometry& geometry)
+    {
+        return geometry.vertices.size() * sizeof(core::Vertex) +
+            geometry.triangles.size() * sizeof(path_tracing::Triangle) +
+            geometry.nodes.size() * sizeof(path_tracing::BVHNode);
+    }
 
-        // Helper to create GPU buffer and retrieve address
-        auto createGPUBuffer = [&](size_t size, void* data, AllocatedBuffer& buffer, VkDeviceAddress& address)
+    VkDeviceSize Renderer::estimateSceneSize(const path_tracing::SceneData& scene) const
+    {
+        VkDeviceSize size = 0;
+        for (const auto& mesh : scene.meshes)
+            size += geometrySize(mesh.geometry) + sizeof(path_tracing::GPUMaterial);
+        // textures already resident are reused
+        for (const auto& [path, texture] : scene.textures)
+        {
+            if (!textureIndices_.contains(path))
+                size += texture.pixels.size();
+        }
+        if (scene.environment.has_value())
         {
-            buffer = createBuffer(
-                size,
-                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                VMA_MEMORY_USAGE_GPU_ONLY);
+            const auto& environment = scene.environment.value();
+            constexpr VkDeviceSize cubeMapSize = 6 * CUBE_MAP_WIDTH * CUBE_MAP_WIDTH * CUBE_MAP_TEXEL_SIZE;
+            size += environment.texels.size() * sizeof(uint32_t) + cubeMapSize +
+                environment.aliasTable.size() * sizeof(path_tracing::AliasEntry);
+        }
+        return size;
+    }
 
-            VkBufferDeviceAddressInfo deviceAddressInfo = {
-                .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = buffer.buffer
-            };
-            address = vkGetBufferDeviceAddress(device_, &deviceAddressInfo);
-            return size;
+    MemoryReport Renderer::memoryReport() const
+    {
+        MemoryReport report;
+        report.budgetExtension = memoryBudgetSupported_;
+
+        auto allocationSize = [&](VmaAllocation allocation) -> VkDeviceSize
+        {
+            if (allocation == VK_NULL_HANDLE)
+                return 0;
+            VmaAllocationInfo info;
+            vmaGetAllocationInfo(allocator_, allocation, &info);
+            return info.size;
+        };
+        auto addMesh = [&](const SceneMesh& sceneMesh)
+        {
+            report[MemoryCategory::Geometry] += sceneMesh.vertices.size + sceneMesh.triangles.size;
+            report[MemoryCategory::BVH] += sceneMesh.nodes.size + sceneMesh.indices.size +
+                allocationSize(sceneMesh.blas.buffer.allocation);
+            report[MemoryCategory::Materials] += sceneMesh.material.size;
+        };
+        for (const auto& [handle, sceneMesh] : sceneMeshes_)
+            addMesh(sceneMesh);
+        if (stagedScene_.has_value())
+        {
+            for (const auto& [handle, sceneMesh] : stagedScene_->meshes)
+                addMesh(sceneMesh);
+        }
+        report[MemoryCategory::Materials] += sceneMeshInfoRange_.size + sceneLightRange_.size + sceneHeaderRange_.size +
+            sceneSobolRange_.size;
+        report[MemoryCategory::SceneHeapFree] = sceneHeap_.capacity() - sceneHeap_.used();
+        report[MemoryCategory::BVH] += allocationSize(tlas_.buffer.allocation);
+
+        auto environmentSize = [&](const Environment& environment)
+        {
+            return allocationSize(environment.equirectangular.allocation) +
+                allocationSize(environment.cubeMap.allocation) + allocationSize(environment.aliasBuffer.allocation);
+        };
+        for (const auto& texture : textures_)
+            report[MemoryCategory::Textures] += allocationSize(texture.allocation);
+        report[MemoryCategory::Environment] = allocationSize(globalResources_.envMap.allocation) +
+            allocationSize(globalResources_.envAliasBuffer.allocation);
+        if (pendingEnvironment_.has_value())
+            report[MemoryCategory::Environment] += environmentSize(pendingEnvironment_.value());
+        if (stagedScene_.has_value() && stagedScene_->environment.has_value())
+            report[MemoryCategory::Environment] += environmentSize(stagedScene_->environment.value());
+        report[MemoryCategory::Framebuffers] = allocationSize(drawImage_.allocation) +
+            allocationSize(postProcessImage_.allocation) + allocationSize(adaptiveBuffer_.allocation) +
+            allocationSize(aovImages_.albedo.allocation) + allocationSize(aovImages_.normalDepth.allocation) +
+            allocationSize(aovImages_.ids.allocation) +
+            allocationSize(filterImages_[0].allocation) + allocationSize(filterImages_[1].allocation) +
+            allocationSize(historyImages_.radiance.allocation) + allocationSize(historyImages_.normalDepth.allocation);
+        report[MemoryCategory::Staging] = uploadManager_.stagingSize();
+        report[MemoryCategory::Wavefront] = allocationSize(wavefrontBuffer_.allocation);
+
+        const VkPhysicalDeviceMemoryProperties* memoryProperties;
+        vmaGetMemoryProperties(allocator_, &memoryProperties);
+        std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+        vmaGetHeapBudgets(allocator_, budgets.data());
+        for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++)
+        {
+            report.heaps.push_back({
+                .usage = budgets[i].usage,
+                .budget = budgets[i].budget,
+                .size = memoryProperties->memoryHeaps[i].size,
+                .deviceLocal = (memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0,
+            });
+        }
+        return report;
+    }
+
+    void Renderer::logMemoryReport() const
+    {
+        std::cout << memoryReport().toString();
+    }
+
+    bool Renderer::warnIfOverBudget(VkDeviceSize additional, const char* operation) const
+    {
+        const MemoryReport report = memoryReport();
+        if (!report.nearBudget(additional))
+            return false;
+
+        std::cerr << "warning: " << operation << " needs about " << formatBytes(additional) << ", "
+            << formatBytes(report.deviceLocalUsage()) << " of the " << formatBytes(report.deviceLocalBudget())
+            << " device memory budget are already in use\n";
+        return true;
+    }
+
+    void Renderer::releaseMeshRanges(const SceneMesh& sceneMesh)
+    {
+        releaseSceneRange(sceneMesh.vertices);
+        releaseSceneRange(sceneMesh.triangles);
+        releaseSceneRange(sceneMesh.nodes);
+        releaseSceneRange(sceneMesh.material);
+        releaseSceneRange(sceneMesh.indices);
+        retireAccelerationStructure(sceneMesh.blas);
+    }
+
+    void Renderer::uploadGeometry(SceneMesh& sceneMesh, const path_tracing::Geometry& geometry)
+    {
+        // the previous ranges stay readable for the frames in flight, MeshInfo switches over on the next commit
+        releaseSceneRange(sceneMesh.vertices);
+        releaseSceneRange(sceneMesh.triangles);
+        releaseSceneRange(sceneMesh.nodes);
+
+        sceneMesh.vertices = uploadSceneRange(geometry.vertices.data(),
+                                              geometry.vertices.size() * sizeof(core::Vertex), sizeof(core::Vertex));
+        sceneMesh.triangles = uploadSceneRange(geometry.triangles.data(),
+                                               geometry.triangles.size() * sizeof(path_tracing::Triangle),
+                                               sizeof(path_tracing::Triangle));
+        sceneMesh.nodes = uploadSceneRange(geometry.nodes.data(),
+                                           geometry.nodes.size() * sizeof(path_tracing::BVHNode),
+                                           sizeof(path_tracing::BVHNode));
+
+        // Triangle carries a tangent next to its indices, the BLAS build wants them packed. The BLAS follows
+        // on the next frame.
+        if (rayQuerySupported_)
+        {
+            releaseSceneRange(sceneMesh.indices);
+            retireAccelerationStructure(sceneMesh.blas);
+            sceneMesh.blas = {};
+
+            std::vector<uint32_t> indices;
+            indices.reserve(geometry.triangles.size() * 3);
+            for (const path_tracing::Triangle& triangle : geometry.triangles)
+                indices.insert(indices.end(), {triangle.v0, triangle.v1, triangle.v2});
+            sceneMesh.indices = uploadSceneRange(indices.data(), indices.size() * sizeof(uint32_t), sizeof(uint32_t));
+        }
+
+        sceneMesh.triangleAreas.clear();
+        sceneMesh.triangleAreas.reserve(geometry.triangles.size());
+        for (const path_tracing::Triangle& triangle : geometry.triangles)
+        {
+            const glm::vec3 v0 = geometry.vertices[triangle.v0].position;
+            const glm::vec3 v1 = geometry.vertices[triangle.v1].position;
+            const glm::vec3 v2 = geometry.vertices[triangle.v2].position;
+            sceneMesh.triangleAreas.push_back(0.5f * glm::length(glm::cross(v1 - v0, v2 - v0)));
+        }
+    }
+
+    void Renderer::uploadMaterial(SceneMesh& sceneMesh, const path_tracing::Material& material,
+                                  const TextureDataMap* decodedTextures)
+    {
+        path_tracing::GPUMaterial m = {
+            .baseCol = material.color,
+            .baseColMapIndex = textureIndex(material.colorMap, true, decodedTextures),
+            .emissiveStrength = material.emissiveStrength,
+            .roughness = material.roughness,
+            .roughnessMapIndex = textureIndex(material.roughnessMap, false, decodedTextures),
+            .metallic = material.metallic,
+            .metallicMapIndex = textureIndex(material.metallicMap, false, decodedTextures),
+            .normalMapIndex = textureIndex(material.normalMap, false, decodedTextures),
         };
+        sceneMesh.normalMapped = m.normalMapIndex > -1;
+        // same luma weights as the shader, textures are not averaged in
+        sceneMesh.emission = material.emissiveStrength * glm::dot(material.color, glm::vec3(0.2f, 0.6f, 0.2f));
+
+        releaseSceneRange(sceneMesh.material);
+        sceneMesh.material = uploadSceneRange(&m, sizeof(path_tracing::GPUMaterial),
+                                              sizeof(path_tracing::GPUMaterial));
+    }
 
-        AllocatedBuffer staging = createBuffer(
-            vertexBufferSize + triangleBufferSize + nodeBufferSize + materialBufferSize + meshInfoBufferSize,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VMA_MEMORY_USAGE_CPU_ONLY);
-        void* stagingData = staging.allocation->GetMappedData();
+    int Renderer::textureIndex(const std::optional<std::string>& path, bool sRGB,
+                               const TextureDataMap* decodedTextures)
+    {
+        if (!path.has_value())
+            return -1;
+
+        // textures are shared between materials and stay resident for the lifetime of the renderer
+        auto it = textureIndices_.find(path.value());
+        if (it != textureIndices_.end())
+            return static_cast<int>(it->second);
 
-        struct BufferData
+        if (textures_.size() >= MAX_TEXTURES)
+            throw std::runtime_error("Too many textures in the scene!");
+
+        const VkFormat format = sRGB ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        if (decodedTextures != nullptr && decodedTextures->contains(path.value()))
+        {
+            // decoded by the scene loader on a worker thread
+            const path_tracing::TextureData& texture = decodedTextures->at(path.value());
+            textures_.push_back(createImage(texture.pixels.data(), texture.size, format, VK_IMAGE_USAGE_SAMPLED_BIT,
+                                            false));
+        }
+        else
         {
-            void* data;
-            size_t size;
-            AllocatedBuffer* dstBuffer;
-            VkDeviceAddress* dstBufferAddress;
+            VkExtent3D texSize = {1, 1, 1};
+            stbi_uc* data = vk_utils::loadTextureData(path.value(), texSize);
+            textures_.push_back(createImage(data, texSize, format, VK_IMAGE_USAGE_SAMPLED_BIT, false));
+            // the pixels are already copied into the upload ring
+            vk_utils::freeImageData(data);
+        }
+
+        const uint32_t index = static_cast<uint32_t>(textures_.size() - 1);
+        VkDescriptorImageInfo textureInfo = {
+            .sampler = globalResources_.defaultLinearSampler,
+            .imageView = textures_.back().imageView,
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+        };
+        VkWriteDescriptorSet write = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptorSets_.pathTracing,
+            .dstBinding = 1,
+            .dstArrayElement = index,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &textureInfo
         };
+        vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+
+        textureIndices_.emplace(path.value(), index);
+        return static_cast<int>(index);
+    }
 
-        const std::vector<BufferData> bufferData = {
-            {sceneVertices.data(), vertexBufferSize, &newScene.vertexBuffer, &newScene.vertexBufferAddress},
-            {sceneTriangles.data(), triangleBufferSize, &newScene.triangleBuffer, &newScene.triangleBufferAddress},
-            {sceneNodes.data(), nodeBufferSize, &newScene.nodeBuffer, &newScene.nodeBufferAddress},
-            {scenemMterials.data(), materialBufferSize, &newScene.materialBuffer, &newScene.materialBufferAddress},
-            {sceneMeshInfos.data(), meshInfoBufferSize, &newScene.meshInfoBuffer, &newScene.meshInfoBufferAddress},
+    // SCENE HEAP
+    AllocatedBuffer Renderer::createSceneHeapBuffer(VkDeviceSize size)
+    {
+        // shared by both queue families so that partial updates need no ownership transfers
+        const uint32_t queueFamilies[2] = {queueFamily_.value(), transferQueueFamily_.value_or(queueFamily_.value())};
+        const bool concurrent = uploadManager_.hasDedicatedQueue();
+        VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+        // the BLAS are built straight from the vertices and indices in the heap
+        if (rayQuerySupported_)
+            usage |= VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+        VkBufferCreateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = size,
+            .usage = usage,
+            .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = concurrent ? 2u : 0u,
+            .pQueueFamilyIndices = concurrent ? queueFamilies : nullptr,
+        };
+        VmaAllocationCreateInfo vmaallocInfo = {
+            .usage = VMA_MEMORY_USAGE_GPU_ONLY,
         };
 
+        AllocatedBuffer newBuffer;
+        VK_CHECK(vmaCreateBuffer(allocator_, &bufferInfo, &vmaallocInfo, &newBuffer.buffer, &newBuffer.allocation,
+                     &newBuffer.info), "Could not create scene heap!");
+        return newBuffer;
+    }
 
-        // Automatically create the GPU buffers and copy data from the vectors to staging buffer
-        size_t currentOffset = 0;
-        for (int i = 0; i < bufferData.size(); i++)
+    void Renderer::growSceneHeap(VkDeviceSize capacity)
+    {
+        const AllocatedBuffer oldBuffer = sceneHeap_.buffer;
+        const VkDeviceSize oldCapacity = sceneHeap_.capacity();
+
+        sceneHeap_.buffer = createSceneHeapBuffer(capacity);
+        VkBufferDeviceAddressInfo deviceAddressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = sceneHeap_.buffer.buffer
+        };
+        sceneHeap_.address = vkGetBufferDeviceAddress(device_, &deviceAddressInfo);
+        sceneHeap_.grow(capacity);
+        // the current header points into the old buffer
+        sceneDirty_ = true;
+
+        // live ranges keep their offsets, only the header has to be rewritten with the new address
+        if (oldBuffer.buffer != VK_NULL_HANDLE)
         {
-            const BufferData& b = bufferData[i];
-            memcpy((char*)stagingData + currentOffset, b.data, b.size);
-            currentOffset += createGPUBuffer(b.size, b.data, *b.dstBuffer, *b.dstBufferAddress);
+            uploadManager_.copyBuffer(oldBuffer.buffer, sceneHeap_.buffer.buffer, oldCapacity);
+            retire([=]()
+            {
+                destroyBuffer(oldBuffer);
+            });
         }
+    }
 
-        // CPU to GPU copy
-        immediateSubmit([&](VkCommandBuffer cmd)
+    SceneHeap::Range Renderer::allocateSceneRange(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        std::optional<SceneHeap::Range> range = sceneHeap_.allocate(size, alignment);
+        if (!range.has_value())
         {
-            size_t currSrcOffset = 0;
-            for (const auto& b : bufferData)
+            // doubling keeps the number of moves logarithmic in the scene size
+            const VkDeviceSize required = (size + alignment + 15) / 16 * 16;
+            growSceneHeap(std::max(sceneHeap_.capacity() * 2, sceneHeap_.capacity() + required));
+            range = sceneHeap_.allocate(size, alignment);
+        }
+        return range.value();
+    }
+
+    void Renderer::releaseSceneRange(const SceneHeap::Range& range)
+    {
+        // in flight frames may still read the range, it can only be handed out again once they are done
+        if (range.size > 0)
+        {
+            retire([=]()
             {
-                VkBufferCopy copy{};
-                copy.srcOffset = currSrcOffset;
-                copy.dstOffset = 0;
-                copy.size = b.size;
+                sceneHeap_.free(range);
+            });
+        }
+    }
 
-                vkCmdCopyBuffer(cmd, staging.buffer, b.dstBuffer->buffer, 1, &copy);
-                currSrcOffset += b.size;
-            }
-        });
-        sceneBuffers_ = newScene;
-        ptPushConstants_ = {
-            newScene.vertexBufferAddress,
-            newScene.triangleBufferAddress,
-            newScene.nodeBufferAddress,
-            newScene.materialBufferAddress,
-            newScene.meshInfoBufferAddress,
-            static_cast<uint32_t>(scene.size()),
-            0
-        };
-        destroyBuffer(staging);
+    SceneHeap::Range Renderer::uploadSceneRange(const void* data, VkDeviceSize size, VkDeviceSize alignment)
+    {
+        const SceneHeap::Range range = allocateSceneRange(size, alignment);
+        if (size > 0)
+            uploadManager_.uploadBuffer(sceneHeap_.buffer.buffer, range.offset, data, size, false);
+        return range;
+    }
 
+    void Renderer::commitScene()
+    {
+        // Geometry and materials are addressed from the heap base, their ranges are aligned to the element size
+        std::vector<path_tracing::MeshInfo> meshInfos;
+        meshInfos.reserve(sceneMeshes_.size());
+        for (const auto& [handle, sceneMesh] : sceneMeshes_)
+        {
+            meshInfos.push_back({
+                .vertexOffset = static_cast<uint32_t>(sceneMesh.vertices.offset / sizeof(core::Vertex)),
+                .triangleOffset = static_cast<uint32_t>(sceneMesh.triangles.offset / sizeof(path_tracing::Triangle)),
+                .nodeOffset = static_cast<uint32_t>(sceneMesh.nodes.offset / sizeof(path_tracing::BVHNode)),
+                .materialIndex = static_cast<uint32_t>(sceneMesh.material.offset / sizeof(path_tracing::GPUMaterial)),
+            });
+        }
 
-        std::vector<path_tracing::TextureCreateSettings> createSettingsVector;
-        createSettingsVector.resize(texturePaths.size());
-        for (auto& tex : texturePaths)
-            createSettingsVector[tex.second.index] = {tex.first, tex.second.sRGB};
+        // every triangle of an emissive mesh becomes a light, picked proportionally to its power
+        std::vector<path_tracing::LightTriangle> lights;
+        std::vector<float> lightWeights;
+        uint32_t meshIndex = 0;
+        for (const auto& [handle, sceneMesh] : sceneMeshes_)
+        {
+            path_tracing::MeshInfo& meshInfo = meshInfos[meshIndex++];
+            if (sceneMesh.emission <= 0.0f)
+                continue;
 
-        if (createSettingsVector.size() > 0)
+            meshInfo.lightOffset = static_cast<uint32_t>(lights.size());
+            for (uint32_t i = 0; i < sceneMesh.triangleAreas.size(); i++)
+            {
+                lights.push_back({
+                    .triIndex = meshInfo.triangleOffset + i,
+                    .vertexOffset = meshInfo.vertexOffset,
+                    .materialIndex = meshInfo.materialIndex,
+                    .area = sceneMesh.triangleAreas[i],
+                });
+                lightWeights.push_back(sceneMesh.triangleAreas[i] * sceneMesh.emission);
+            }
+        }
+        const std::vector<path_tracing::AliasEntry> aliasTable = path_tracing::buildAliasTable(lightWeights);
+        for (size_t i = 0; i < lights.size(); i++)
         {
-            uploadTextures(createSettingsVector);
+            lights[i].probability = aliasTable[i].probability;
+            lights[i].alias = aliasTable[i].alias;
+            lights[i].pmf = aliasTable[i].pmf;
         }
 
-        deletionQueue_.push_function([&]()
+        releaseSceneRange(sceneMeshInfoRange_);
+        sceneMeshInfoRange_ = uploadSceneRange(meshInfos.data(), meshInfos.size() * sizeof(path_tracing::MeshInfo),
+                                               sizeof(path_tracing::MeshInfo));
+        releaseSceneRange(sceneLightRange_);
+        sceneLightRange_ = uploadSceneRange(lights.data(), lights.size() * sizeof(path_tracing::LightTriangle),
+                                            sizeof(path_tracing::LightTriangle));
+
+        // the header is never overwritten in place, frames in flight keep reading the previous one
+        path_tracing::SceneHeader header = {
+            .heapAddress = sceneHeap_.address,
+            .meshCount = static_cast<uint32_t>(meshInfos.size()),
+            .lightCount = static_cast<uint32_t>(lights.size()),
+        };
+        header.streamOffsets[static_cast<uint32_t>(path_tracing::SceneStream::MeshInfos)] = sceneMeshInfoRange_.offset;
+        header.streamOffsets[static_cast<uint32_t>(path_tracing::SceneStream::Lights)] = sceneLightRange_.offset;
+        header.streamOffsets[static_cast<uint32_t>(path_tracing::SceneStream::Sobol)] = sceneSobolRange_.offset;
+        releaseSceneRange(sceneHeaderRange_);
+        sceneHeaderRange_ = uploadSceneRange(&header, sizeof(path_tracing::SceneHeader), 16);
+
+        ptPushConstants_.sceneHeader = sceneHeap_.address + sceneHeaderRange_.offset;
+        resetAccumulation();
+        tlasDirty_ = rayQuerySupported_;
+        uploadWaitValue_ = uploadManager_.flush();
+        sceneDirty_ = false;
+    }
+
+    Renderer::AccelerationStructure Renderer::recordAccelerationStructureBuild(
+        VkCommandBuffer cmd, VkAccelerationStructureTypeKHR type, const VkAccelerationStructureGeometryKHR& geometry,
+        uint32_t primitiveCount)
+    {
+        VkAccelerationStructureBuildGeometryInfoKHR buildInfo = {
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+            .type = type,
+            .flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
+            .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+            .geometryCount = 1,
+            .pGeometries = &geometry,
+        };
+        VkAccelerationStructureBuildSizesInfoKHR sizes = {
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+        };
+        accelerationStructureFunctions_.getBuildSizes(device_, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+                                                      &buildInfo, &primitiveCount, &sizes);
+
+        AccelerationStructure accelerationStructure;
+        accelerationStructure.buffer = createBuffer(sizes.accelerationStructureSize,
+                                                    VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+                                                    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                    VMA_MEMORY_USAGE_GPU_ONLY);
+        VkAccelerationStructureCreateInfoKHR createInfo = {
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+            .buffer = accelerationStructure.buffer.buffer,
+            .size = sizes.accelerationStructureSize,
+            .type = type,
+        };
+        VK_CHECK(accelerationStructureFunctions_.create(device_, &createInfo, nullptr, &accelerationStructure.handle),
+                 "Could not create acceleration structure!");
+        VkAccelerationStructureDeviceAddressInfoKHR addressInfo = {
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+            .accelerationStructure = accelerationStructure.handle,
+        };
+        accelerationStructure.address = accelerationStructureFunctions_.getDeviceAddress(device_, &addressInfo);
+
+        // the scratch address has an alignment requirement of its own, the allocation leaves room to round it up
+        const AllocatedBuffer scratch = createBuffer(sizes.buildScratchSize + scratchAlignment_,
+                                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                     VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                     VMA_MEMORY_USAGE_GPU_ONLY);
+        VkBufferDeviceAddressInfo scratchAddressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = scratch.buffer
+        };
+        const VkDeviceAddress scratchAddress = vkGetBufferDeviceAddress(device_, &scratchAddressInfo);
+        buildInfo.dstAccelerationStructure = accelerationStructure.handle;
+        buildInfo.scratchData.deviceAddress = (scratchAddress + scratchAlignment_ - 1) / scratchAlignment_ *
+            scratchAlignment_;
+
+        const VkAccelerationStructureBuildRangeInfoKHR range = {.primitiveCount = primitiveCount};
+        const VkAccelerationStructureBuildRangeInfoKHR* ranges = &range;
+        accelerationStructureFunctions_.cmdBuild(cmd, 1, &buildInfo, &ranges);
+        retire([=]()
         {
-            destroyBuffer(sceneBuffers_.vertexBuffer);
-            destroyBuffer(sceneBuffers_.triangleBuffer);
-            destroyBuffer(sceneBuffers_.nodeBuffer);
-            destroyBuffer(sceneBuffers_.materialBuffer);
-            destroyBuffer(sceneBuffers_.meshInfoBuffer);
+            destroyBuffer(scratch);
         });
+        return accelerationStructure;
     }
 
-    void Renderer::uploadTextures(const std::vector<path_tracing::TextureCreateSettings>& settings)
+    void Renderer::recordAccelerationStructureBuilds(VkCommandBuffer cmd)
     {
-        std::vector<VkDescriptorImageInfo> texturesInfo;
-        for (auto& sett : settings)
+        // The heap keeps the geometry at the same offsets for the lifetime of a mesh, so a BLAS only has to be
+        // built once. The instance index is the mesh index of the MeshInfo stream.
+        std::vector<VkAccelerationStructureInstanceKHR> instances;
+        uint32_t meshIndex = 0;
+        for (auto& [handle, sceneMesh] : sceneMeshes_)
         {
-            VkExtent3D texSize = {1, 1, 1};
-            stbi_uc* data = vk_utils::loadTextureData(sett.name, texSize);
+            const uint32_t triangleCount = static_cast<uint32_t>(sceneMesh.indices.size / (3 * sizeof(uint32_t)));
+            const uint32_t vertexCount = static_cast<uint32_t>(sceneMesh.vertices.size / sizeof(core::Vertex));
+            if (triangleCount == 0)
+            {
+                meshIndex++;
+                continue;
+            }
 
-            if(sett.sRGB)
-                textures_.push_back(createImage(data, texSize, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_SAMPLED_BIT,
-                                        false));
-            else
-                textures_.push_back(createImage(data, texSize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT,
-                        false));
+            if (sceneMesh.blas.handle == VK_NULL_HANDLE)
+            {
+                const VkAccelerationStructureGeometryKHR geometry = {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+                    .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+                    .geometry = {
+                        .triangles = {
+                            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+                            .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+                            .vertexData = {.deviceAddress = sceneHeap_.address + sceneMesh.vertices.offset},
+                            .vertexStride = sizeof(core::Vertex),
+                            .maxVertex = vertexCount - 1,
+                            .indexType = VK_INDEX_TYPE_UINT32,
+                            .indexData = {.deviceAddress = sceneHeap_.address + sceneMesh.indices.offset},
+                        },
+                    },
+                    .flags = VK_GEOMETRY_OPAQUE_BIT_KHR,
+                };
+                sceneMesh.blas = recordAccelerationStructureBuild(cmd, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+                                                                  geometry, triangleCount);
+            }
 
-            texturesInfo.emplace_back(globalResources_.defaultLinearSampler, textures_.back().imageView,
-                                      VK_IMAGE_LAYOUT_GENERAL);
+            instances.push_back({
+                .transform = {.matrix = {{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}}},
+                .instanceCustomIndex = meshIndex++,
+                .mask = 0xFF,
+                .instanceShaderBindingTableRecordOffset = 0,
+                .flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR,
+                .accelerationStructureReference = sceneMesh.blas.address,
+            });
         }
-        VkWriteDescriptorSet write = {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = descriptorSets_.pathTracing,
-            .dstBinding = 1,
-            .descriptorCount = static_cast<uint32_t>(texturesInfo.size()),
-            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .pImageInfo = texturesInfo.data()
+        vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                                VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+                                VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                                VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR);
+
+        // a few bytes per mesh, written straight from the host
+        const AllocatedBuffer instanceBuffer = createBuffer(
+            std::max<size_t>(instances.size(), 1) * sizeof(VkAccelerationStructureInstanceKHR),
+            VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+        memcpy(instanceBuffer.info.pMappedData, instances.data(),
+               instances.size() * sizeof(VkAccelerationStructureInstanceKHR));
+        VkBufferDeviceAddressInfo instanceAddressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = instanceBuffer.buffer
+        };
+        const VkAccelerationStructureGeometryKHR geometry = {
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+            .geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+            .geometry = {
+                .instances = {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+                    .arrayOfPointers = VK_FALSE,
+                    .data = {.deviceAddress = vkGetBufferDeviceAddress(device_, &instanceAddressInfo)},
+                },
+            },
+            .flags = VK_GEOMETRY_OPAQUE_BIT_KHR,
         };
-        vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
 
-        deletionQueue_.push_function([&]()
+        // frames in flight keep tracing the previous TLAS
+        retireAccelerationStructure(tlas_);
+        tlas_ = recordAccelerationStructureBuild(cmd, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, geometry,
+                                                 static_cast<uint32_t>(instances.size()));
+        retire([=]()
         {
-            for (auto& img : textures_)
-                destroyImage(img);
+            destroyBuffer(instanceBuffer);
         });
+        vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                                VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+                                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR);
+
+        ptPushConstants_.tlas = tlas_.address;
+        tlasDirty_ = false;
     }
 
+    void Renderer::retireAccelerationStructure(const AccelerationStructure& accelerationStructure)
+    {
+        if (accelerationStructure.handle == VK_NULL_HANDLE)
+            return;
+        retire([=]()
+        {
+            accelerationStructureFunctions_.destroy(device_, accelerationStructure.handle, nullptr);
+            destroyBuffer(accelerationStructure.buffer);
+        });
+    }
 
     // PER-FRAME FUNCTIONS
     void Renderer::render(const core::Camera& camera)
@@ -1180,13 +2214,66 @@ namespace renderer
         ImGui_ImplGlfw_NewFrame();
     }
 
+    void Renderer::commitPendingChanges()
+    {
+        // Frame boundary: a scene prepared in the background is swapped in once all of its uploads are done,
+        // edits since the last frame become visible together
+        if (stagedScene_.has_value() && uploadManager_.isComplete(stagedScene_->uploadValue))
+            swapStagedScene();
+        if (pendingEnvironment_.has_value())
+        {
+            applyEnvironment(pendingEnvironment_.value());
+            pendingEnvironment_.reset();
+        }
+        if (sceneDirty_)
+            commitScene();
+    }
+
+    void Renderer::recordPendingWork(VkCommandBuffer cmd)
+    {
+        for (auto& work : pendingGraphicsWork_)
+            work(cmd);
+        pendingGraphicsWork_.clear();
+        // kept up to date whenever supported so that switching backends does not wait for a build
+        if (tlasDirty_)
+            recordAccelerationStructureBuilds(cmd);
+    }
+
+    void Renderer::settlePendingChanges()
+    {
+        VK_CHECK(vkDeviceWaitIdle(device_), "Could not wait for the frames in flight!");
+        flushRetiredResources(false);
+        // the render shows the latest scene, a staged one is waited for instead of swapped in by a later frame
+        if (stagedScene_.has_value())
+            uploadManager_.wait(stagedScene_->uploadValue);
+        commitPendingChanges();
+        // the immediate submission acquires everything uploaded so far and waits for those uploads
+        immediateSubmit([&](VkCommandBuffer cmd)
+        {
+            recordPendingWork(cmd);
+        });
+    }
+
     void Renderer::draw()
     {
         vkWaitForFences(device_, 1, &getCurrentFrame().renderFence, true, 1000000000);
         vkResetFences(device_, 1, &getCurrentFrame().renderFence);
-
-        unsigned int imageIndex;
-        vkAcquireNextImageKHR(device_, swapchain_, 1000000000, getCurrentFrame().swapSemaphore, nullptr, &imageIndex);
+        // the frame that last used this camera slot is done now
+        auto* cameras = static_cast<uint8_t*>(globalResources_.buffer.allocation->GetMappedData());
+        memcpy(cameras + cameraOffset(), &cameraUniform_, sizeof(CameraUniform));
+        flushRetiredResources(false);
+        readTimestamps();
+        updateBenchmark();
+
+        commitPendingChanges();
+        updateDynamicResolution();
+
+        unsigned int imageIndex = 0;
+        if (!headless_)
+        {
+            vkAcquireNextImageKHR(device_, swapchain_, 1000000000, getCurrentFrame().swapSemaphore, nullptr,
+                                  &imageIndex);
+        }
 
         VkCommandBuffer cmd = getCurrentFrame().mainCommandBuffer;
         VK_CHECK(vkResetCommandBuffer(cmd, 0), "");
@@ -1197,6 +2284,10 @@ namespace renderer
         };
         VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo), "Could not begin command buffer!");
 
+        // Take ownership of freshly uploaded resources and run the work that was waiting on them
+        uploadManager_.recordAcquireBarriers(cmd, uploadWaitValue_);
+        recordPendingWork(cmd);
+
         if (frameNumber_ == 0)
         {
             vk_utils::transitionImage(cmd, drawImage_.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
@@ -1205,6 +2296,20 @@ namespace renderer
             VkImageSubresourceRange clearRange = vk_utils::getImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
             vkCmdClearColorImage(cmd, drawImage_.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &clearRange);
             vkCmdClearColorImage(cmd, postProcessImage_.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &clearRange);
+            for (const AllocatedImage* image : {&aovImages_.albedo, &aovImages_.normalDepth, &filterImages_[0],
+                                                &filterImages_[1], &historyImages_.radiance,
+                                                &historyImages_.normalDepth})
+            {
+                vk_utils::transitionImage(cmd, image->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+                vkCmdClearColorImage(cmd, image->image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &clearRange);
+            }
+            VkClearColorValue idClearValue;
+            idClearValue.uint32[0] = NO_AOV_ID;
+            idClearValue.uint32[1] = NO_AOV_ID;
+            idClearValue.uint32[2] = 0;
+            idClearValue.uint32[3] = 0;
+            vk_utils::transitionImage(cmd, aovImages_.ids.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+            vkCmdClearColorImage(cmd, aovImages_.ids.image, VK_IMAGE_LAYOUT_GENERAL, &idClearValue, 1, &clearRange);
         }
         else
         {
@@ -1212,84 +2317,984 @@ namespace renderer
                                       VK_IMAGE_LAYOUT_GENERAL);
         }
 
-        // Draw the compute result on the intermediate image
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_.pathTracing);
-        std::vector<VkDescriptorSet> sets = {descriptorSets_.glboal, descriptorSets_.pathTracing};
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts_.pathTracing, 0, 2,
-                                sets.data(), 0, nullptr);
-        vkCmdPushConstants(cmd, pipelineLayouts_.pathTracing, VK_SHADER_STAGE_COMPUTE_BIT, 0,
-                           sizeof(path_tracing::PushConstants),
-                           &ptPushConstants_);
-        vkCmdDispatch(cmd, std::ceil(swapchainExtent_.width / 16.0), std::ceil(swapchainExtent_.height / 16.0), 1);
+        // Draw the compute result on the intermediate image, nothing to trace before the first environment is in
+        if (globalResources_.envMap.image != VK_NULL_HANDLE)
+        {
+            // the path tracer overwrites the accumulation of the previous camera
+            if (reprojectHistory_)
+                recordHistoryCopy(cmd);
+
+            FrameTiming& timing = frameTimings_[frameNumber_ % FRAME_OVERLAP];
+            if (timing.queryPool != VK_NULL_HANDLE)
+            {
+                vkCmdResetQueryPool(cmd, timing.queryPool, 0, 2);
+                vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timing.queryPool, 0);
+            }
+            passesPerFrame_ = budgetedPasses();
+            recordAccumulationPasses(cmd, passesPerFrame_);
+            if (ptPushConstants_.interleave > 1)
+                recordFill(cmd);
+            if (timing.queryPool != VK_NULL_HANDLE)
+            {
+                vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timing.queryPool, 1);
+                timing.written = true;
+                timing.mode = pathTracingMode_;
+                timing.interleave = ptPushConstants_.interleave;
+                timing.passes = passesPerFrame_;
+            }
+
+            if (reprojectHistory_)
+            {
+                vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+                                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                        VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+                recordReprojection(cmd);
+            }
+        }
+        reprojectHistory_ = false;
 
+        // the following passes read the images written by the path tracer
+        vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+        if (denoising_)
+            recordDenoising(cmd);
+        ppPushConstants_.denoised = denoising_ ? 1 : 0;
 
         vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_.postProcessing);
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts_.postProcessing, 0, 1,
-                                &descriptorSets_.postProcessing, 0,
+        const std::array<VkDescriptorSet, 2> postProcessingSets = {descriptorSets_.postProcessing, descriptorSets_.aovs};
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts_.postProcessing, 0,
+                                static_cast<uint32_t>(postProcessingSets.size()), postProcessingSets.data(), 0,
                                 nullptr);
         vkCmdPushConstants(cmd, pipelineLayouts_.postProcessing, VK_SHADER_STAGE_COMPUTE_BIT, 0,
                            sizeof(PostProcessingPushConstants),
                            &ppPushConstants_);
         vkCmdDispatch(cmd, std::ceil(swapchainExtent_.width / 16.0), std::ceil(swapchainExtent_.height / 16.0), 1);
 
-        // Copy the drawing result onto the swap chain image
+        // Copy the drawing result onto the swap chain image, headless it stays in the post processing image
         vk_utils::transitionImage(cmd, postProcessImage_.image, VK_IMAGE_LAYOUT_GENERAL,
                                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-        vk_utils::transitionImage(cmd, swapchainImages_[imageIndex], VK_IMAGE_LAYOUT_UNDEFINED,
-                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        if (!headless_)
+        {
+            vk_utils::transitionImage(cmd, swapchainImages_[imageIndex], VK_IMAGE_LAYOUT_UNDEFINED,
+                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-        vk_utils::copyImageToImage(cmd, postProcessImage_.image, swapchainImages_[imageIndex], swapchainExtent_,
-                                   swapchainExtent_);
+            vk_utils::copyImageToImage(cmd, postProcessImage_.image, swapchainImages_[imageIndex], swapchainExtent_,
+                                       swapchainExtent_);
 
-        // Transition to draw gui onto swap chain image
-        vk_utils::transitionImage(cmd, swapchainImages_[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                  VK_IMAGE_LAYOUT_GENERAL);
-        drawImgui(cmd, swapchainImageViews_[imageIndex]);
+            // Transition to draw gui onto swap chain image
+            vk_utils::transitionImage(cmd, swapchainImages_[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_GENERAL);
+            drawImgui(cmd, swapchainImageViews_[imageIndex]);
 
-        // Transition to present
-        vk_utils::transitionImage(cmd, swapchainImages_[imageIndex], VK_IMAGE_LAYOUT_GENERAL,
-                                  VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+            // Transition to present
+            vk_utils::transitionImage(cmd, swapchainImages_[imageIndex], VK_IMAGE_LAYOUT_GENERAL,
+                                      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        }
 
         VK_CHECK(vkEndCommandBuffer(cmd), "Could not record command buffer!");
 
-        VkSemaphoreSubmitInfo waitInfo = vk_utils::semaphoreSubmitInfo(
-            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, getCurrentFrame().swapSemaphore);
+        VkSemaphoreSubmitInfo waitInfos[2] = {
+            vk_utils::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+                                          getCurrentFrame().swapSemaphore),
+            uploadManager_.waitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, uploadWaitValue_),
+        };
         VkSemaphoreSubmitInfo signalInfo = vk_utils::semaphoreSubmitInfo(
             VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, getCurrentFrame().renderSemaphore);
         VkCommandBufferSubmitInfo cmdInfo = vk_utils::commandBufferSubmitInfo(cmd);
-        VkSubmitInfo2 submitInfo = vk_utils::submitInfo(&cmdInfo, &signalInfo, &waitInfo);
+        // headless only the uploads are waited for and nobody waits on the frame but its fence
+        VkSubmitInfo2 submitInfo = headless_
+                                       ? vk_utils::submitInfo(&cmdInfo, nullptr, &waitInfos[1], 1)
+                                       : vk_utils::submitInfo(&cmdInfo, &signalInfo, &waitInfos[0], 2);
 
         VK_CHECK(vkQueueSubmit2(queue_, 1, &submitInfo, getCurrentFrame().renderFence),
                  "Could not submit queue!");
 
-        VkPresentInfoKHR presentInfo = {
-            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &getCurrentFrame().renderSemaphore,
-            .swapchainCount = 1,
-            .pSwapchains = &swapchain_,
-            .pImageIndices = &imageIndex,
-        };
+        if (!headless_)
+        {
+            VkPresentInfoKHR presentInfo = {
+                .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+                .waitSemaphoreCount = 1,
+                .pWaitSemaphores = &getCurrentFrame().renderSemaphore,
+                .swapchainCount = 1,
+                .pSwapchains = &swapchain_,
+                .pImageIndices = &imageIndex,
+            };
 
-        VK_CHECK(vkQueuePresentKHR(queue_, &presentInfo), "Could not present");
+            VK_CHECK(vkQueuePresentKHR(queue_, &presentInfo), "Could not present");
+        }
         frameNumber_++;
         ptPushConstants_.frame++;
     }
 
-    void Renderer::updateGlobalDescriptors(const core::Camera& camera) const
+    ImageReadback Renderer::readOutput(Aov aov)
+    {
+        const AllocatedImage* image = &drawImage_;
+        VkDeviceSize texelSize = 4 * sizeof(float);
+        if (aov == Aov::Albedo || aov == Aov::HitCount)
+        {
+            image = &aovImages_.albedo;
+            texelSize = 4 * sizeof(uint16_t);
+        }
+        else if (aov == Aov::Normal || aov == Aov::Depth)
+            image = &aovImages_.normalDepth;
+        else if (aov == Aov::MeshId || aov == Aov::MaterialId)
+            image = &aovImages_.ids;
+
+        const VkExtent3D extent = image->imageExtent;
+        const size_t pixelCount = static_cast<size_t>(extent.width) * extent.height;
+        // the images stay in the general layout
+        AllocatedBuffer staging = readbackImage(*image, VK_IMAGE_LAYOUT_GENERAL, texelSize);
+
+        ImageReadback readback = {.width = extent.width, .height = extent.height};
+        const auto* floats = static_cast<const float*>(staging.info.pMappedData);
+        const auto* halfs = static_cast<const uint16_t*>(staging.info.pMappedData);
+        const auto* uints = static_cast<const uint32_t*>(staging.info.pMappedData);
+        auto id = [](uint32_t value) { return value == NO_AOV_ID ? -1.0f : static_cast<float>(value); };
+        switch (aov)
+        {
+        case Aov::Depth:
+        case Aov::MeshId:
+        case Aov::MaterialId:
+        case Aov::HitCount:
+            readback.channels = 1;
+            break;
+        default:
+            readback.channels = 3;
+            break;
+        }
+        readback.pixels.resize(pixelCount * readback.channels);
+        for (size_t i = 0; i < pixelCount; i++)
+        {
+            float* pixel = &readback.pixels[i * readback.channels];
+            switch (aov)
+            {
+            case Aov::Albedo:
+                for (uint32_t c = 0; c < 3; c++)
+                    pixel[c] = glm::unpackHalf1x16(halfs[i * 4 + c]);
+                break;
+            case Aov::HitCount:
+                pixel[0] = glm::unpackHalf1x16(halfs[i * 4 + 3]);
+                break;
+            case Aov::Depth:
+                pixel[0] = floats[i * 4 + 3];
+                break;
+            case Aov::MeshId:
+                pixel[0] = id(uints[i * 4]);
+                break;
+            case Aov::MaterialId:
+                pixel[0] = id(uints[i * 4 + 1]);
+                break;
+            default:
+                for (uint32_t c = 0; c < 3; c++)
+                    pixel[c] = floats[i * 4 + c];
+                break;
+            }
+        }
+
+        destroyBuffer(staging);
+        return readback;
+    }
+
+    ImageReadback Renderer::readDisplay()
+    {
+        const VkExtent3D extent = postProcessImage_.imageExtent;
+        const size_t pixelCount = static_cast<size_t>(extent.width) * extent.height;
+        // left for the copy to the swap chain at the end of every frame
+        AllocatedBuffer staging = readbackImage(postProcessImage_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                                4 * sizeof(uint16_t));
+
+        ImageReadback readback = {.width = extent.width, .height = extent.height, .channels = 3};
+        readback.pixels.resize(pixelCount * readback.channels);
+        const auto* unorms = static_cast<const uint16_t*>(staging.info.pMappedData);
+        for (size_t i = 0; i < pixelCount; i++)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+                readback.pixels[i * 3 + c] = static_cast<float>(unorms[i * 4 + c]) / 65535.0f;
+        }
+
+        destroyBuffer(staging);
+        return readback;
+    }
+
+    AllocatedBuffer Renderer::readbackImage(const AllocatedImage& image, VkImageLayout layout,
+                                            VkDeviceSize texelSize)
+    {
+        const VkExtent3D extent = image.imageExtent;
+        AllocatedBuffer staging = createBuffer(static_cast<size_t>(extent.width) * extent.height * texelSize,
+                                               VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+        immediateSubmit([&](VkCommandBuffer cmd)
+        {
+            // the frames submitted before only have to be done writing
+            vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT,
+                                    VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+            VkBufferImageCopy region = {
+                .imageSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .layerCount = 1,
+                },
+                .imageExtent = extent,
+            };
+            vkCmdCopyImageToBuffer(cmd, image.image, layout, staging.buffer, 1, &region);
+        });
+        vmaInvalidateAllocation(allocator_, staging.allocation, 0, VK_WHOLE_SIZE);
+        return staging;
+    }
+
+    void Renderer::renderTiled(const core::Camera& camera, const TiledRenderSettings& settings)
+    {
+        if (frameNumber_ == 0 || globalResources_.envMap.image == VK_NULL_HANDLE)
+            throw std::runtime_error("Tiled renders start from a rendered frame!");
+        if (settings.width == 0 || settings.height == 0)
+            throw std::runtime_error("Tiled render without pixels!");
+        settlePendingChanges();
+
+        // One draw image pixel is one output pixel, the tiles at the right and bottom border are cut off
+        const VkExtent2D tile = swapchainExtent_;
+        const uint32_t tilesX = (settings.width + tile.width - 1) / tile.width;
+        const uint32_t tilesY = (settings.height + tile.height - 1) / tile.height;
+        const VkExtent2D output = {settings.width, settings.height};
+
+        PfmWriter writer(settings.path, settings.width, settings.height);
+        // a row of tiles stays on the host until its last tile is read back
+        std::vector<float> strip(static_cast<size_t>(settings.width) * tile.height * 3);
+
+        // The frames in flight are the ring of tiles, one is rendered while the one before is read back
+        const VkDeviceSize readbackSize = static_cast<VkDeviceSize>(tile.width) * tile.height * 4 * sizeof(float);
+        std::array<AllocatedBuffer, FRAME_OVERLAP> readbacks;
+        std::array<std::optional<glm::uvec2>, FRAME_OVERLAP> pendingTiles;
+        for (auto& readback : readbacks)
+            readback = createBuffer(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+        auto finishTile = [&](uint32_t slot)
+        {
+            const glm::uvec2 tileIndex = pendingTiles[slot].value();
+            pendingTiles[slot].reset();
+            VK_CHECK(vkWaitForFences(device_, 1, &frames_[slot].renderFence, true, UINT64_MAX),
+                     "Could not wait for a tile!");
+            vmaInvalidateAllocation(allocator_, readbacks[slot].allocation, 0, VK_WHOLE_SIZE);
+            const auto* texels = static_cast<const float*>(readbacks[slot].info.pMappedData);
+
+            const uint32_t originX = tileIndex.x * tile.width;
+            const uint32_t width = std::min(tile.width, settings.width - originX);
+            const uint32_t rows = std::min(tile.height, settings.height - tileIndex.y * tile.height);
+            for (uint32_t y = 0; y < rows; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    const float* texel = &texels[(static_cast<size_t>(y) * tile.width + x) * 4];
+                    float* pixel = &strip[(static_cast<size_t>(y) * settings.width + originX + x) * 3];
+                    std::copy_n(texel, 3, pixel);
+                }
+            }
+            if (tileIndex.x + 1 == tilesX)
+                writer.writeStrip(strip.data(), rows);
+        };
+
+        const uint32_t interleave = ptPushConstants_.interleave;
+        ptPushConstants_.interleave = 1;
+        const uint32_t frames = std::max(settings.framesPerTile, 1u);
+        uint32_t submitted = 0;
+        // bottom row first, that is the order of the rows in the file
+        for (uint32_t tileY = tilesY; tileY-- > 0;)
+        {
+            for (uint32_t tileX = 0; tileX < tilesX; tileX++)
+            {
+                const glm::uvec2 origin = {tileX * tile.width, tileY * tile.height};
+                const CameraUniform tileCamera = regionCamera(camera, output, origin);
+                // A tile can hold thousands of passes, they are split into bounded submissions like in renderRegion.
+                // Only the last one reads the tile back.
+                for (uint32_t firstFrame = 0; firstFrame < frames; firstFrame += REGION_PASSES_PER_SUBMIT)
+                {
+                    const uint32_t slot = submitted++ % FRAME_OVERLAP;
+                    if (pendingTiles[slot].has_value())
+                        finishTile(slot);
+                    VK_CHECK(vkWaitForFences(device_, 1, &frames_[slot].renderFence, true, UINT64_MAX),
+                             "Could not wait for a tile!");
+
+                    const uint32_t passes = std::min(REGION_PASSES_PER_SUBMIT, frames - firstFrame);
+                    const bool lastPasses = firstFrame + passes == frames;
+                    submitOnFrame(slot, [&](VkCommandBuffer cmd)
+                    {
+                        recordRegion(cmd, tileCamera, firstFrame, passes,
+                                     lastPasses ? readbacks[slot].buffer : VK_NULL_HANDLE);
+                    });
+                    if (lastPasses)
+                        pendingTiles[slot] = glm::uvec2(tileX, tileY);
+                }
+            }
+        }
+        // the oldest tile first
+        for (uint32_t i = 0; i < FRAME_OVERLAP; i++)
+        {
+            const uint32_t slot = (submitted + i) % FRAME_OVERLAP;
+            if (pendingTiles[slot].has_value())
+                finishTile(slot);
+        }
+
+        for (const auto& readback : readbacks)
+            destroyBuffer(readback);
+        // the draw image holds the last tile now
+        ptPushConstants_.interleave = interleave;
+        resetAccumulation();
+    }
+
+    std::vector<float> Renderer::renderRegion(const core::Camera& camera, VkExtent2D output, glm::uvec2 origin,
+                                              uint32_t sampleOffset, uint32_t samples)
+    {
+        if (frameNumber_ == 0 || globalResources_.envMap.image == VK_NULL_HANDLE)
+            throw std::runtime_error("Region renders start from a rendered frame!");
+        settlePendingChanges();
+
+        const size_t floatCount = static_cast<size_t>(swapchainExtent_.width) * swapchainExtent_.height * 4;
+        AllocatedBuffer readback = createBuffer(floatCount * sizeof(float), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                VMA_MEMORY_USAGE_GPU_TO_CPU);
+        CameraUniform cam = regionCamera(camera, output, origin);
+        cam.sampleOffset = sampleOffset;
+        // one sample per pass, the alpha of the accumulation counts them
+        const uint32_t interleave = ptPushConstants_.interleave;
+        const uint32_t samplesPerPass = ptPushConstants_.samples;
+        ptPushConstants_.interleave = 1;
+        ptPushConstants_.samples = 1;
+        // A unit can hold hundreds of passes. They are split into bounded submissions on the fence of a frame slot,
+        // which is waited for without a timeout.
+        const uint32_t frames = std::max(samples, 1u);
+        for (uint32_t firstFrame = 0; firstFrame < frames; firstFrame += REGION_PASSES_PER_SUBMIT)
+        {
+            const uint32_t passes = std::min(REGION_PASSES_PER_SUBMIT, frames - firstFrame);
+            submitOnFrame(0, [&](VkCommandBuffer cmd)
+            {
+                recordRegion(cmd, cam, firstFrame, passes,
+                             firstFrame + passes == frames ? readback.buffer : VK_NULL_HANDLE);
+            });
+            VK_CHECK(vkWaitForFences(device_, 1, &frames_[0].renderFence, true, UINT64_MAX),
+                     "Could not wait for a region!");
+        }
+        ptPushConstants_.interleave = interleave;
+        ptPushConstants_.samples = samplesPerPass;
+        vmaInvalidateAllocation(allocator_, readback.allocation, 0, VK_WHOLE_SIZE);
+
+        const auto* texels = static_cast<const float*>(readback.info.pMappedData);
+        std::vector<float> accumulation(texels, texels + floatCount);
+        destroyBuffer(readback);
+        // the draw image holds the region now
+        resetAccumulation();
+        return accumulation;
+    }
+
+    CameraUniform Renderer::regionCamera(const core::Camera& camera, VkExtent2D output, glm::uvec2 origin) const
     {
-        void* data = globalResources_.buffer.allocation->GetMappedData();
-        CameraUniform cam = {
+        // the path tracer spreads its rays over the 16x16 tiled grid of the dispatch
+        const glm::vec2 grid = {(swapchainExtent_.width + 15) / 16 * 16, (swapchainExtent_.height + 15) / 16 * 16};
+        const glm::vec2 size = {output.width, output.height};
+        const glm::mat4 proj = glm::perspective(glm::radians(camera.fov), size.x / size.y, camera.nearPlane,
+                                                camera.farPlane);
+        return {
             .position = camera.position,
             .invView = glm::inverse(camera.viewMatrix),
-            .invProj = glm::inverse(camera.projMatrix)
+            .invProj = glm::inverse(proj),
+            .prevView = camera.viewMatrix,
+            .prevProj = proj,
+            .crop = glm::vec4(glm::vec2(origin) / size, grid / size),
+        };
+    }
+
+    void Renderer::recordRegion(VkCommandBuffer cmd, const CameraUniform& camera, uint32_t firstFrame,
+                                uint32_t frames, VkBuffer readback)
+    {
+        // The previous region may still read the camera and the draw image. The camera is updated in the command
+        // buffer so that it changes in order with the regions.
+        vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT,
+                                VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT);
+        vkCmdUpdateBuffer(cmd, globalResources_.buffer.buffer, cameraOffset(), sizeof(CameraUniform), &camera);
+        vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_UNIFORM_READ_BIT);
+
+        ptPushConstants_.frame = firstFrame;
+        recordAccumulationPasses(cmd, frames);
+        if (readback == VK_NULL_HANDLE)
+            return;
+
+        vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+        VkBufferImageCopy region = {
+            .imageSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .layerCount = 1,
+            },
+            .imageExtent = drawImage_.imageExtent,
+        };
+        vkCmdCopyImageToBuffer(cmd, drawImage_.image, VK_IMAGE_LAYOUT_GENERAL, readback, 1, &region);
+    }
+
+    void Renderer::submitOnFrame(uint32_t slot, const std::function<void(VkCommandBuffer cmd)>& record)
+    {
+        FrameData& frame = frames_[slot];
+        VK_CHECK(vkResetFences(device_, 1, &frame.renderFence), "");
+
+        VkCommandBuffer cmd = frame.mainCommandBuffer;
+        VK_CHECK(vkResetCommandBuffer(cmd, 0), "");
+        VkCommandBufferBeginInfo cmdBeginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo), "Could not begin command buffer!");
+        record(cmd);
+        VK_CHECK(vkEndCommandBuffer(cmd), "Could not record command buffer!");
+
+        VkCommandBufferSubmitInfo cmdInfo = vk_utils::commandBufferSubmitInfo(cmd);
+        VkSubmitInfo2 submitInfo = vk_utils::submitInfo(&cmdInfo, nullptr, nullptr);
+        VK_CHECK(vkQueueSubmit2(queue_, 1, &submitInfo, frame.renderFence), "Could not submit a region!");
+    }
+
+    void Renderer::recordDenoising(VkCommandBuffer cmd)
+    {
+        auto barrier = [&]()
+        {
+            vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+                                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                    VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+        };
+        auto dispatch = [&](const DenoisingPushConstants& constants)
+        {
+            vkCmdPushConstants(cmd, pipelineLayouts_.denoising, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(DenoisingPushConstants), &constants);
+            vkCmdDispatch(cmd, std::ceil(swapchainExtent_.width / 16.0), std::ceil(swapchainExtent_.height / 16.0), 1);
+            barrier();
+        };
+
+        const std::array<VkDescriptorSet, 2> sets = {descriptorSets_.denoising, descriptorSets_.aovs};
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_.denoising);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts_.denoising, 0,
+                                static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+
+        // The iterations ping-pong between the filter images, starting on the side that makes the last one write
+        // the first image, which is the one bound to the post processing
+        const uint32_t iterations = std::max(denoisingIterations_, 1u);
+        DenoisingPushConstants constants = dnPushConstants_;
+        constants.stage = DenoisingStage::Prepare;
+        constants.target = iterations % 2;
+        dispatch(constants);
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            constants.stage = i + 1 == iterations ? DenoisingStage::Final : DenoisingStage::Filter;
+            constants.step = 1 << i;
+            constants.source = constants.target;
+            constants.target ^= 1;
+            dispatch(constants);
+        }
+    }
+
+    void Renderer::recordHistoryCopy(VkCommandBuffer cmd)
+    {
+        const std::array<std::pair<VkImage, VkImage>, 2> copies = {
+            std::pair{drawImage_.image, historyImages_.radiance.image},
+            std::pair{aovImages_.normalDepth.image, historyImages_.normalDepth.image},
+        };
+        for (const auto& [source, destination] : copies)
+        {
+            vk_utils::transitionImage(cmd, source, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+            vk_utils::transitionImage(cmd, destination, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            vk_utils::copyImageToImage(cmd, source, destination, swapchainExtent_, swapchainExtent_);
+            vk_utils::transitionImage(cmd, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+            vk_utils::transitionImage(cmd, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+        }
+    }
+
+    void Renderer::recordReprojection(VkCommandBuffer cmd)
+    {
+        const std::array<VkDescriptorSet, 3> sets = {
+            descriptorSets_.glboal[activeEnvironment_], descriptorSets_.reprojection, descriptorSets_.aovs
+        };
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_.reprojection);
+        const uint32_t offset = cameraOffset();
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts_.reprojection, 0,
+                                static_cast<uint32_t>(sets.size()), sets.data(), 1, &offset);
+        vkCmdPushConstants(cmd, pipelineLayouts_.reprojection, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(ReprojectionPushConstants), &rpPushConstants_);
+        vkCmdDispatch(cmd, std::ceil(swapchainExtent_.width / 16.0), std::ceil(swapchainExtent_.height / 16.0), 1);
+    }
+
+    void Renderer::updateDynamicResolution()
+    {
+        const bool moved = cameraMoved_;
+        cameraMoved_ = false;
+        // adaptive sampling selects the traced pixels with its own tile lists, a reset without motion starts over
+        // at full resolution
+        if (!dynamicResolution_ || adaptiveSampling_ || (!moved && ptPushConstants_.frame == 0))
+        {
+            ptPushConstants_.interleave = 1;
+            refinementFrames_ = 0;
+            return;
+        }
+
+        if (moved)
+        {
+            uint32_t interleave = 1;
+            while (interleave < MAX_INTERLEAVE &&
+                fullResolutionTimeMs_ / (interleave * interleave) > targetFrameTimeMs_)
+                interleave++;
+            ptPushConstants_.interleave = interleave;
+            refinementFrames_ = interleave * interleave - 1;
+            // the traced pixel moves on every frame so that the reprojected history covers the whole block
+            ptPushConstants_.interleavePhase++;
+        }
+        else if (refinementFrames_ > 0)
+        {
+            refinementFrames_--;
+            ptPushConstants_.interleavePhase++;
+        }
+        else
+        {
+            ptPushConstants_.interleave = 1;
+        }
+    }
+
+    uint32_t Renderer::budgetedPasses() const
+    {
+        // Interleaved frames already trade resolution for time, the reprojection runs after a single pass, and the
+        // benchmark compares single passes
+        if (!timeBudget_ || ptPushConstants_.interleave > 1 || reprojectHistory_ || benchmark_.has_value() ||
+            fullResolutionTimeMs_ <= 0.0)
+            return 1;
+        const auto passes = static_cast<uint32_t>(targetFrameTimeMs_ / fullResolutionTimeMs_);
+        return std::clamp(passes, 1u, std::max(maxPassesPerFrame_, 1u));
+    }
+
+    void Renderer::recordFill(VkCommandBuffer cmd)
+    {
+        vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pathTracingPipeline(path_tracing::PathTracingKernel::Fill));
+        vkCmdPushConstants(cmd, pipelineLayouts_.pathTracing, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(path_tracing::PushConstants), &ptPushConstants_);
+        vkCmdDispatch(cmd, std::ceil(swapchainExtent_.width / 16.0), std::ceil(swapchainExtent_.height / 16.0), 1);
+    }
+
+    void Renderer::recordAccumulationPasses(VkCommandBuffer cmd, uint32_t passes)
+    {
+        std::vector<VkDescriptorSet> sets = {
+            descriptorSets_.glboal[activeEnvironment_], descriptorSets_.pathTracing, descriptorSets_.aovs
         };
-        memcpy(data, &cam, sizeof(CameraUniform));
+        const uint32_t offset = cameraOffset();
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts_.pathTracing, 0,
+                                static_cast<uint32_t>(sets.size()), sets.data(), 1, &offset);
+
+        // The frame counter of the passes before the last one is advanced here, the caller advances the last one
+        for (uint32_t pass = 0; pass < passes; pass++)
+        {
+            if (pass > 0)
+            {
+                constexpr VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+                    VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+                vk_utils::memoryBarrier(cmd, stages, VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                        stages, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT |
+                                        VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT);
+                ptPushConstants_.frame++;
+            }
+            switch (pathTracingMode_)
+            {
+            case PathTracingMode::Wavefront:
+                recordWavefront(cmd);
+                break;
+            case PathTracingMode::PersistentThreads:
+                recordPersistentThreads(cmd);
+                break;
+            default:
+                recordMegakernel(cmd);
+                break;
+            }
+        }
+    }
+
+    void Renderer::recordMegakernel(VkCommandBuffer cmd)
+    {
+        if (!adaptiveSampling_)
+        {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              pathTracingPipeline(path_tracing::PathTracingKernel::Megakernel));
+            vkCmdPushConstants(cmd, pipelineLayouts_.pathTracing, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(path_tracing::PushConstants),
+                               &ptPushConstants_);
+            const double interleave = ptPushConstants_.interleave;
+            vkCmdDispatch(cmd, std::ceil(swapchainExtent_.width / (16.0 * interleave)),
+                          std::ceil(swapchainExtent_.height / (16.0 * interleave)), 1);
+            return;
+        }
+
+        constexpr VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        auto barrier = [&]()
+        {
+            vk_utils::memoryBarrier(cmd, stages, VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                    stages, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT |
+                                    VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        };
+        if (adaptiveBuffer_.buffer == VK_NULL_HANDLE)
+            createAdaptiveBuffer(cmd);
+
+        const VkPipeline megakernel = pathTracingPipeline(path_tracing::PathTracingKernel::Megakernel);
+        const VkPipeline tileVariance = pathTracingPipeline(path_tracing::PathTracingKernel::TileVariance);
+
+        // Every tile is traced after a reset, afterwards only the ones the variance pass of the last frame kept
+        path_tracing::PushConstants constants = ptPushConstants_;
+        constants.adaptive = adaptiveAddress_;
+        constants.adaptiveRead = ptPushConstants_.frame == 0 ? path_tracing::ADAPTIVE_ALL_TILES : adaptiveTileList_;
+        constants.adaptiveWrite = adaptiveTileList_ ^ 1;
+        const path_tracing::AdaptiveTileList emptyList{};
+        vkCmdUpdateBuffer(cmd, adaptiveBuffer_.buffer, adaptiveTileListOffsets_[constants.adaptiveWrite],
+                          sizeof(path_tracing::AdaptiveTileList), &emptyList);
+        barrier();
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, megakernel);
+        vkCmdPushConstants(cmd, pipelineLayouts_.pathTracing, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(path_tracing::PushConstants), &constants);
+        if (constants.adaptiveRead == path_tracing::ADAPTIVE_ALL_TILES)
+            vkCmdDispatch(cmd, std::ceil(swapchainExtent_.width / 16.0), std::ceil(swapchainExtent_.height / 16.0), 1);
+        else
+            vkCmdDispatchIndirect(cmd, adaptiveBuffer_.buffer, adaptiveTileListOffsets_[constants.adaptiveRead]);
+        barrier();
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tileVariance);
+        vkCmdDispatch(cmd, std::ceil(swapchainExtent_.width / 16.0), std::ceil(swapchainExtent_.height / 16.0), 1);
+        barrier();
+        adaptiveTileList_ = constants.adaptiveWrite;
+    }
+
+    void Renderer::createAdaptiveBuffer(VkCommandBuffer cmd)
+    {
+        using namespace path_tracing;
+        const VkExtent3D extent = drawImage_.imageExtent;
+        const VkDeviceSize pixelCount = static_cast<VkDeviceSize>(extent.width) * extent.height;
+        const VkDeviceSize tileCount = static_cast<VkDeviceSize>(
+            (extent.width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE) *
+            ((extent.height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE);
+
+        // [state | tile list 0 | tile list 1 | moments], all 16 byte aligned
+        const VkDeviceSize tileListSize = (sizeof(AdaptiveTileList) + tileCount * sizeof(uint32_t) + 15) / 16 * 16;
+        adaptiveTileListOffsets_ = {64, 64 + tileListSize};
+        const VkDeviceSize momentsOffset = 64 + 2 * tileListSize;
+        const VkDeviceSize size = momentsOffset + pixelCount * sizeof(float);
+        static_assert(sizeof(AdaptiveState) <= 64);
+
+        warnIfOverBudget(size, "allocating the adaptive sampling buffers");
+        adaptiveBuffer_ = createBuffer(size,
+                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                       VMA_MEMORY_USAGE_GPU_ONLY);
+        VkBufferDeviceAddressInfo addressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = adaptiveBuffer_.buffer
+        };
+        adaptiveAddress_ = vkGetBufferDeviceAddress(device_, &addressInfo);
+
+        const AdaptiveState state = {
+            .moments = adaptiveAddress_ + momentsOffset,
+            .tileLists = {adaptiveAddress_ + adaptiveTileListOffsets_[0], adaptiveAddress_ + adaptiveTileListOffsets_[1]},
+        };
+        vkCmdUpdateBuffer(cmd, adaptiveBuffer_.buffer, 0, sizeof(AdaptiveState), &state);
+        // the moments are only read after the first full frame, which writes all of them
+        adaptiveTileList_ = 0;
+        resetAccumulation();
+
+        deletionQueue_.push_function([=]()
+        {
+            destroyBuffer(adaptiveBuffer_);
+        });
+    }
+
+    void Renderer::createWavefrontBuffer(VkCommandBuffer cmd)
+    {
+        using namespace path_tracing;
+        const VkDeviceSize pixelCount = static_cast<VkDeviceSize>(drawImage_.imageExtent.width) *
+            drawImage_.imageExtent.height;
+
+        // [state | counters | path queue 0 | path queue 1 | hits | shadow rays | radiance], all 16 byte aligned
+        const VkDeviceSize countersOffset = WAVEFRONT_COUNTERS_OFFSET;
+        const VkDeviceSize pathQueueOffset = countersOffset + WAVEFRONT_QUEUE_COUNT * sizeof(WavefrontQueueCounter);
+        const VkDeviceSize hitsOffset = pathQueueOffset + 2 * pixelCount * sizeof(WavefrontPath);
+        const VkDeviceSize shadowOffset = hitsOffset + pixelCount * sizeof(WavefrontHit);
+        const VkDeviceSize radianceOffset = shadowOffset + pixelCount * sizeof(WavefrontShadowRay);
+        const VkDeviceSize size = radianceOffset + pixelCount * sizeof(glm::vec4);
+        static_assert(sizeof(WavefrontState) <= WAVEFRONT_COUNTERS_OFFSET);
+
+        warnIfOverBudget(size, "allocating the wavefront queues");
+        wavefrontBuffer_ = createBuffer(size,
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                        VMA_MEMORY_USAGE_GPU_ONLY);
+        VkBufferDeviceAddressInfo addressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = wavefrontBuffer_.buffer
+        };
+        const VkDeviceAddress address = vkGetBufferDeviceAddress(device_, &addressInfo);
+        ptPushConstants_.wavefront = address;
+
+        const WavefrontState state = {
+            .counters = address + countersOffset,
+            .pathQueues = {address + pathQueueOffset, address + pathQueueOffset + pixelCount * sizeof(WavefrontPath)},
+            .hits = address + hitsOffset,
+            .shadowQueue = address + shadowOffset,
+            .radiance = address + radianceOffset,
+        };
+        vkCmdUpdateBuffer(cmd, wavefrontBuffer_.buffer, 0, sizeof(WavefrontState), &state);
+        vkCmdFillBuffer(cmd, wavefrontBuffer_.buffer, radianceOffset, pixelCount * sizeof(glm::vec4), 0);
+
+        deletionQueue_.push_function([=]()
+        {
+            destroyBuffer(wavefrontBuffer_);
+        });
+    }
+
+    void Renderer::resetWavefrontQueues(VkCommandBuffer cmd, uint32_t firstQueue, uint32_t queueCount) const
+    {
+        const std::array<path_tracing::WavefrontQueueCounter, path_tracing::WAVEFRONT_QUEUE_COUNT> counters{};
+        vkCmdUpdateBuffer(cmd, wavefrontBuffer_.buffer,
+                          WAVEFRONT_COUNTERS_OFFSET + firstQueue * sizeof(path_tracing::WavefrontQueueCounter),
+                          queueCount * sizeof(path_tracing::WavefrontQueueCounter), counters.data());
+    }
+
+    void Renderer::recordWavefront(VkCommandBuffer cmd)
+    {
+        using path_tracing::PathTracingKernel;
+        constexpr VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        auto barrier = [&]()
+        {
+            vk_utils::memoryBarrier(cmd, stages, VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                    stages, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT |
+                                    VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        };
+
+        if (wavefrontBuffer_.buffer == VK_NULL_HANDLE)
+        {
+            createWavefrontBuffer(cmd);
+            barrier();
+        }
+
+        // Resolve the pipelines first, a missing fallback variant is compiled on the spot
+        std::array<VkPipeline, 5> pipelines = {
+            pathTracingPipeline(PathTracingKernel::Generate), pathTracingPipeline(PathTracingKernel::Extend),
+            pathTracingPipeline(PathTracingKernel::Shade), pathTracingPipeline(PathTracingKernel::Connect),
+            pathTracingPipeline(PathTracingKernel::Accumulate),
+        };
+        auto [generate, extend, shade, connect, accumulate] = pipelines;
+
+        path_tracing::PushConstants constants = ptPushConstants_;
+        auto dispatch = [&](VkPipeline pipeline, uint32_t queue, bool indirect)
+        {
+            constants.wavefrontQueue = queue;
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+            vkCmdPushConstants(cmd, pipelineLayouts_.pathTracing, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(path_tracing::PushConstants), &constants);
+            if (indirect)
+            {
+                vkCmdDispatchIndirect(cmd, wavefrontBuffer_.buffer,
+                                      WAVEFRONT_COUNTERS_OFFSET + queue * sizeof(path_tracing::WavefrontQueueCounter));
+            }
+            else
+            {
+                // over the traced pixels only
+                const double interleave = constants.interleave;
+                vkCmdDispatch(cmd, std::ceil(swapchainExtent_.width / (16.0 * interleave)),
+                              std::ceil(swapchainExtent_.height / (16.0 * interleave)), 1);
+            }
+            barrier();
+        };
+
+        // The number of bounces is known up front, passes over queues that already ran dry dispatch no workgroups
+        for (uint32_t sample = 0; sample < ptPushConstants_.samples; sample++)
+        {
+            constants.wavefrontSample = sample;
+            resetWavefrontQueues(cmd, 0, path_tracing::WAVEFRONT_QUEUE_COUNT);
+            barrier();
+            dispatch(generate, 0, false);
+            for (uint32_t bounce = 0; bounce <= ptPushConstants_.bounces; bounce++)
+            {
+                const uint32_t queue = bounce % 2;
+                dispatch(extend, queue, true);
+                dispatch(shade, queue, true);
+                dispatch(connect, path_tracing::WAVEFRONT_SHADOW_QUEUE, true);
+                resetWavefrontQueues(cmd, queue, 1);
+                resetWavefrontQueues(cmd, path_tracing::WAVEFRONT_SHADOW_QUEUE, 1);
+                barrier();
+            }
+        }
+        dispatch(accumulate, 0, false);
+    }
+
+    void Renderer::recordPersistentThreads(VkCommandBuffer cmd)
+    {
+        if (workCounterBuffer_.buffer == VK_NULL_HANDLE)
+        {
+            workCounterBuffer_ = createBuffer(sizeof(uint32_t),
+                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                              VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+            VkBufferDeviceAddressInfo addressInfo = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = workCounterBuffer_.buffer
+            };
+            ptPushConstants_.workCounter = vkGetBufferDeviceAddress(device_, &addressInfo);
+            deletionQueue_.push_function([=]()
+            {
+                destroyBuffer(workCounterBuffer_);
+            });
+        }
+
+        vkCmdFillBuffer(cmd, workCounterBuffer_.buffer, 0, sizeof(uint32_t), 0);
+        vk_utils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pathTracingPipeline(path_tracing::PathTracingKernel::Persistent));
+        vkCmdPushConstants(cmd, pipelineLayouts_.pathTracing, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(path_tracing::PushConstants), &ptPushConstants_);
+        vkCmdDispatch(cmd, persistentWorkgroups_, 1, 1);
+    }
+
+    void Renderer::createTimestampQueries()
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &queueFamilyCount, queueFamilies.data());
+        if (queueFamilies[queueFamily_.value()].timestampValidBits == 0)
+            return;
+
+        timestampPeriod_ = properties.limits.timestampPeriod;
+        VkQueryPoolCreateInfo queryPoolInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2,
+        };
+        for (auto& timing : frameTimings_)
+        {
+            VK_CHECK(vkCreateQueryPool(device_, &queryPoolInfo, nullptr, &timing.queryPool),
+                     "Could not create timestamp query pool!");
+        }
+        deletionQueue_.push_function([=]()
+        {
+            for (const auto& timing : frameTimings_)
+                vkDestroyQueryPool(device_, timing.queryPool, nullptr);
+        });
+    }
+
+    void Renderer::readTimestamps()
+    {
+        // the frame that used this slot last has finished, its results are available without waiting
+        FrameTiming& timing = frameTimings_[frameNumber_ % FRAME_OVERLAP];
+        if (!timing.written)
+            return;
+        timing.written = false;
+
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(device_, timing.queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+            return;
+
+        // per accumulation pass, the number of passes changes with the time budget
+        const double milliseconds = static_cast<double>(timestamps[1] - timestamps[0]) * timestampPeriod_ / 1e6 /
+            timing.passes;
+        pathTracingTimeMs_ = pathTracingTimeMs_ == 0.0 ? milliseconds : pathTracingTimeMs_ * 0.9 + milliseconds * 0.1;
+        const double fullResolutionMs = milliseconds * timing.interleave * timing.interleave;
+        fullResolutionTimeMs_ = fullResolutionTimeMs_ == 0.0
+                                    ? fullResolutionMs
+                                    : fullResolutionTimeMs_ * 0.9 + fullResolutionMs * 0.1;
+        if (benchmark_.has_value())
+        {
+            const auto mode = static_cast<size_t>(timing.mode);
+            benchmark_->totalMs[mode] += milliseconds;
+            benchmark_->frames[mode]++;
+        }
+    }
+
+    void Renderer::startBenchmark(uint32_t framesPerMode)
+    {
+        if (timestampPeriod_ == 0.0f)
+        {
+            benchmarkResult_ = "Timestamps are not supported on this queue";
+            return;
+        }
+        benchmark_ = Benchmark{.framesPerMode = framesPerMode, .restoreMode = pathTracingMode_};
+        benchmarkResult_.clear();
+        pathTracingMode_ = PathTracingMode::Megakernel;
+        resetAccumulation();
+    }
+
+    void Renderer::updateBenchmark()
+    {
+        if (!benchmark_.has_value())
+            return;
+
+        // Every mode renders the same number of frames from a reset accumulation, frames still in flight from
+        // the previous mode are counted for the mode they were recorded with
+        const auto mode = static_cast<size_t>(pathTracingMode_);
+        if (benchmark_->frames[mode] < benchmark_->framesPerMode)
+            return;
+        if (mode + 1 < benchmark_->frames.size())
+        {
+            pathTracingMode_ = static_cast<PathTracingMode>(mode + 1);
+            resetAccumulation();
+            return;
+        }
+
+        // speedups are relative to the megakernel
+        const double megakernel = benchmark_->totalMs[0] / benchmark_->frames[0];
+        benchmarkResult_.clear();
+        for (size_t i = 0; i < benchmark_->frames.size(); i++)
+        {
+            const double average = benchmark_->totalMs[i] / benchmark_->frames[i];
+            benchmarkResult_ += std::format("{}{} {:.2f} ms ({:.2f}x)", i == 0 ? "" : ", ",
+                                            pathTracingModeName(static_cast<PathTracingMode>(i)), average,
+                                            megakernel / average);
+        }
+        std::cout << "Path tracing benchmark (" << swapchainExtent_.width << "x" << swapchainExtent_.height << ", "
+            << ptPushConstants_.samples << " spp, " << ptPushConstants_.bounces << " bounces): " << benchmarkResult_
+            << "\n";
+        pathTracingMode_ = benchmark_->restoreMode;
+        benchmark_.reset();
+        resetAccumulation();
+    }
+
+    void Renderer::updateGlobalDescriptors(const core::Camera& camera)
+    {
+        cameraUniform_ = {
+            .position = camera.position,
+            .invView = glm::inverse(camera.viewMatrix),
+            .invProj = glm::inverse(camera.projMatrix),
+            .prevView = previousView_,
+            .prevProj = previousProj_
+        };
+        previousView_ = camera.viewMatrix;
+        previousProj_ = camera.projMatrix;
+    }
+
+    uint32_t Renderer::cameraOffset() const
+    {
+        return static_cast<uint32_t>(frameNumber_ % FRAME_OVERLAP * globalResources_.cameraStride);
     }
 
     void Renderer::resetAccumulation()
     {
         ptPushConstants_.frame = 0;
+        reprojectHistory_ = false;
+    }
+
+    void Renderer::reprojectAccumulation()
+    {
+        cameraMoved_ = true;
+        if (!temporalReprojection_ || adaptiveSampling_)
+        {
+            resetAccumulation();
+            return;
+        }
+        // a reset earlier in the frame already dropped the history
+        if (ptPushConstants_.frame != 0)
+            reprojectHistory_ = true;
+        ptPushConstants_.frame = 0;
     }
 
 
@@ -1357,44 +3362,15 @@ namespace renderer
         return newImage;
     }
 
-    AllocatedImage Renderer::createImage(stbi_uc* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage,
+    AllocatedImage Renderer::createImage(const stbi_uc* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage,
                                          bool mipmapped)
     {
-        size_t dataSize = size.depth * size.width * size.height * 4;
-        AllocatedBuffer uploadbuffer = createBuffer(dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                                    VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-        memcpy(uploadbuffer.info.pMappedData, data, dataSize);
-
         AllocatedImage newImage = createImage(size, format,
                                               usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
                                               mipmapped);
 
-        immediateSubmit([&](VkCommandBuffer cmd)
-        {
-            vk_utils::transitionImage(cmd, newImage.image, VK_IMAGE_LAYOUT_UNDEFINED,
-                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-            VkBufferImageCopy copyRegion = {
-                .bufferOffset = 0,
-                .bufferRowLength = 0,
-                .bufferImageHeight = 0,
-                .imageExtent = size
-            };
-            copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            copyRegion.imageSubresource.mipLevel = 0;
-            copyRegion.imageSubresource.baseArrayLayer = 0;
-            copyRegion.imageSubresource.layerCount = 1;
-
-            // copy the buffer into the image
-            vkCmdCopyBufferToImage(cmd, uploadbuffer.buffer, newImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                                   &copyRegion);
-
-            vk_utils::transitionImage(cmd, newImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                      VK_IMAGE_LAYOUT_GENERAL);
-        });
-
-        destroyBuffer(uploadbuffer);
+        // copied asynchronously, the first frame using it waits on the upload timeline
+        uploadManager_.uploadImage(newImage.image, size, 4, data, VK_IMAGE_LAYOUT_GENERAL);
 
         return newImage;
     }
@@ -1431,6 +3407,28 @@ namespace renderer
         vmaDestroyImage(allocator_, image.image, image.allocation);
     }
 
+    void Renderer::retire(std::function<void()>&& function)
+    {
+        // copies reading the resource may still be recording, submitting them gives the value to wait for
+        retiredResources_.push_back({frameNumber_, uploadManager_.flush(), std::move(function)});
+    }
+
+    void Renderer::flushRetiredResources(bool all)
+    {
+        // frames complete in order, once this frame's fence is signaled every frame up to
+        // frameNumber_ - FRAME_OVERLAP is done
+        while (!retiredResources_.empty())
+        {
+            const RetiredResource& resource = retiredResources_.front();
+            if (!all && (resource.frame + FRAME_OVERLAP > frameNumber_ ||
+                !uploadManager_.isComplete(resource.uploadValue)))
+                break;
+
+            resource.destroy();
+            retiredResources_.pop_front();
+        }
+    }
+
     void Renderer::immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function)
     {
         VK_CHECK(vkResetFences(device_, 1, &immediateHandles_.fence), "");
@@ -1444,11 +3442,15 @@ namespace renderer
         };
 
         VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo), "");
+        const uint64_t uploadValue = uploadManager_.flush();
+        uploadManager_.recordAcquireBarriers(cmd, uploadValue);
         function(cmd);
         VK_CHECK(vkEndCommandBuffer(cmd), "");
 
         VkCommandBufferSubmitInfo cmdinfo = vk_utils::commandBufferSubmitInfo(cmd);
-        VkSubmitInfo2 submit = vk_utils::submitInfo(&cmdinfo, nullptr, nullptr);
+        VkSemaphoreSubmitInfo uploadWaitInfo = uploadManager_.waitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                                                        uploadValue);
+        VkSubmitInfo2 submit = vk_utils::submitInfo(&cmdinfo, nullptr, &uploadWaitInfo);
 
         // submit command buffer to the queue and execute it.
         // the fence will now block until the function commands finish execution
@@ -1460,11 +3462,27 @@ namespace renderer
     void Renderer::cleanup()
     {
         vkDeviceWaitIdle(device_);
-        ImGui_ImplVulkan_Shutdown();
-        for (auto frame : frames_)
+        if (!headless_)
+            ImGui_ImplVulkan_Shutdown();
+        discardStagedScene();
+        clearScene();
+        retireAccelerationStructure(tlas_);
+        if (pendingEnvironment_.has_value())
+            destroyEnvironment(pendingEnvironment_.value());
+        // the active one goes with the global resources
+        for (const auto& [path, environment] : residentEnvironments_)
         {
-            frame.deletionQueue.flush();
+            if (environment.cubeMap.image == globalResources_.envMap.image)
+                continue;
+            if (environment.equirectangular.image != VK_NULL_HANDLE)
+                destroyImage(environment.equirectangular);
+            destroyImage(environment.cubeMap);
+            destroyBuffer(environment.aliasBuffer);
         }
+        residentEnvironments_.clear();
+        flushRetiredResources(true);
+        for (auto& frame : frames_)
+            frame.deletionQueue.flush();
         deletionQueue_.flush();
     }
 } // pt
@@ -8,19 +8,60 @@
 #include <functional>
 #include <stb_image.h>
 #include <array>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <future>
 
 #include "vk_utils/vk_descriptors.h"
+#include "vk_utils/vk_acceleration_structure.h"
+#include "renderer/upload_manager.h"
+#include "renderer/scene_heap.h"
+#include "renderer/memory_report.h"
 #include "path_tracing/mesh.h"
+#include "path_tracing/scene.h"
 #include "core/camera.h"
 
 namespace renderer
 {
+    using MeshHandle = uint32_t;
+
+    enum class PathTracingMode : uint32_t
+    {
+        Megakernel = 0, // one invocation follows its pixel through every bounce
+        Wavefront, // generate, extend, shade and connect passes connected by ray queues
+        PersistentThreads, // a device filling number of workgroups pulling pixels from a global counter
+        Count
+    };
+
+    const char* pathTracingModeName(PathTracingMode mode);
+    const char* aovName(Aov aov);
+
+    // Host copy of one output of the path tracer, row major with channels floats per pixel
+    struct ImageReadback
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t channels = 0;
+        std::vector<float> pixels;
+    };
+
+    // Output of Renderer::renderTiled, any size independent of the window
+    struct TiledRenderSettings
+    {
+        std::string path; // linear PFM image
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t framesPerTile = 256;
+    };
+
     class Renderer
     {
         struct Pipelines
         {
-            VkPipeline pathTracing = VK_NULL_HANDLE;
             VkPipeline postProcessing = VK_NULL_HANDLE;
+            VkPipeline denoising = VK_NULL_HANDLE;
+            VkPipeline reprojection = VK_NULL_HANDLE;
             VkPipeline cubemapCreation = VK_NULL_HANDLE;
         };
 
@@ -28,6 +69,8 @@ namespace renderer
         {
             VkPipelineLayout pathTracing = VK_NULL_HANDLE;
             VkPipelineLayout postProcessing = VK_NULL_HANDLE;
+            VkPipelineLayout denoising = VK_NULL_HANDLE;
+            VkPipelineLayout reprojection = VK_NULL_HANDLE;
             VkPipelineLayout cubemapCreation = VK_NULL_HANDLE;
         };
 
@@ -35,49 +78,248 @@ namespace renderer
         {
             VkDescriptorSetLayout global = VK_NULL_HANDLE;
             VkDescriptorSetLayout pathTracing = VK_NULL_HANDLE;
+            VkDescriptorSetLayout aovs = VK_NULL_HANDLE;
             VkDescriptorSetLayout postProcessing = VK_NULL_HANDLE;
+            VkDescriptorSetLayout denoising = VK_NULL_HANDLE;
+            VkDescriptorSetLayout reprojection = VK_NULL_HANDLE;
             VkDescriptorSetLayout cubemapCreation = VK_NULL_HANDLE;
         };
 
         struct DescriptorSets
         {
-            VkDescriptorSet glboal = VK_NULL_HANDLE;
+            // the environment dependent sets are double buffered, see applyEnvironment()
+            std::array<VkDescriptorSet, 2> glboal = {};
             VkDescriptorSet pathTracing = VK_NULL_HANDLE;
+            VkDescriptorSet aovs = VK_NULL_HANDLE;
             VkDescriptorSet postProcessing = VK_NULL_HANDLE;
-            VkDescriptorSet cubemapCreation = VK_NULL_HANDLE;
+            VkDescriptorSet denoising = VK_NULL_HANDLE;
+            VkDescriptorSet reprojection = VK_NULL_HANDLE;
+            std::array<VkDescriptorSet, 2> cubemapCreation = {};
         };
 
         struct GlobalResources
         {
+            // One CameraUniform per frame in flight, cameraStride apart. Bound as a dynamic uniform buffer so that a
+            // frame never writes the camera the previous one still reads.
             AllocatedBuffer buffer;
+            VkDeviceSize cameraStride = 0;
             AllocatedImage envMap;
+            AllocatedBuffer envAliasBuffer;
             VkSampler defaultLinearSampler = VK_NULL_HANDLE;
         };
 
+        // Arbitrary output variables of the first hit, accumulated by the path tracer next to the radiance
+        struct AovImages
+        {
+            AllocatedImage albedo;
+            AllocatedImage normalDepth; // shading normal in xyz, linear depth in w, 0 for the environment
+            AllocatedImage ids; // mesh and material index of the latest frame
+        };
+
+        // Accumulation and first hits of the previous camera, read by the reprojection
+        struct HistoryImages
+        {
+            AllocatedImage radiance;
+            AllocatedImage normalDepth;
+        };
+
+        struct RetiredResource
+        {
+            uint64_t frame = 0;
+            uint64_t uploadValue = 0;
+            std::function<void()> destroy;
+        };
+
+        struct AccelerationStructure
+        {
+            VkAccelerationStructureKHR handle = VK_NULL_HANDLE;
+            AllocatedBuffer buffer;
+            VkDeviceAddress address = 0;
+        };
+
+        // heap ranges owned by one mesh of the scene
+        struct SceneMesh
+        {
+            SceneHeap::Range vertices;
+            SceneHeap::Range triangles;
+            SceneHeap::Range nodes;
+            SceneHeap::Range material;
+            // packed triangle indices and the BLAS built from them, only with the ray query backend
+            SceneHeap::Range indices;
+            AccelerationStructure blas;
+            bool normalMapped = false;
+            // light sampling weights, kept for every mesh since a material override can make any of them emissive
+            std::vector<float> triangleAreas;
+            float emission = 0.0f;
+        };
+
+        struct Environment
+        {
+            AllocatedImage equirectangular;
+            AllocatedImage cubeMap;
+            AllocatedBuffer aliasBuffer;
+            VkDeviceAddress aliasAddress = 0;
+            uint32_t samplingWidth = 0;
+            uint32_t samplingHeight = 0;
+        };
+
+        // A scene uploaded next to the current one, swapped in at a frame boundary once its uploads are done
+        struct StagedScene
+        {
+            std::map<MeshHandle, SceneMesh> meshes;
+            std::optional<Environment> environment;
+            uint64_t uploadValue = 0;
+        };
+
+        struct PendingShaderVariant
+        {
+            path_tracing::ShaderVariant variant;
+            std::future<VkPipeline> pipeline;
+        };
+
+        struct FrameTiming
+        {
+            VkQueryPool queryPool = VK_NULL_HANDLE;
+            bool written = false;
+            PathTracingMode mode = PathTracingMode::Megakernel;
+            uint32_t interleave = 1;
+            uint32_t passes = 1;
+        };
+
+        struct Benchmark
+        {
+            uint32_t framesPerMode = 0;
+            PathTracingMode restoreMode = PathTracingMode::Megakernel;
+            std::array<uint32_t, static_cast<size_t>(PathTracingMode::Count)> frames = {};
+            std::array<double, static_cast<size_t>(PathTracingMode::Count)> totalMs = {};
+        };
+
+        using TextureDataMap = std::unordered_map<std::string, path_tracing::TextureData>;
+
+        static constexpr VkDeviceSize INITIAL_SCENE_HEAP_SIZE = 64 * 1024 * 1024;
+        static constexpr const char* PIPELINE_CACHE_DIRECTORY = "./cache";
+        // the WavefrontState comes first in the wavefront buffer, the queue counters follow
+        static constexpr VkDeviceSize WAVEFRONT_COUNTERS_OFFSET = 64;
+        // The cube map of an environment has a fixed size whatever the size of the equirectangular image. It is
+        // written by a compute shader so it needs a storage compatible format.
+        static constexpr uint32_t CUBE_MAP_WIDTH = 512;
+        static constexpr VkFormat CUBE_MAP_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+        static constexpr VkDeviceSize CUBE_MAP_TEXEL_SIZE = 4 * sizeof(uint16_t);
+        // bounds the length of a submission of renderRegion, a software device may need seconds for a single pass
+        static constexpr uint32_t REGION_PASSES_PER_SUBMIT = 8;
+
     public:
         void init(GLFWwindow* window);
+        // Without a window, swap chain or GUI, the frames only end up in the images of the given size
+        void initHeadless(VkExtent2D extent);
         void newImGuiFrame();
         void render(const core::Camera& camera);
-        void uploadPathTracingScene(const std::vector<path_tracing::Mesh>& scene);
-        void uploadTextures(const std::vector<path_tracing::TextureCreateSettings>& settings);
+        // Replaces the whole scene
+        std::vector<MeshHandle> uploadPathTracingScene(const std::vector<path_tracing::Mesh>& scene);
+        // Incremental edits only upload what changed, they become visible together at the start of the next frame
+        MeshHandle addMesh(const path_tracing::Mesh& mesh);
+        void replaceMesh(MeshHandle handle, const path_tracing::Mesh& mesh);
+        void updateMaterial(MeshHandle handle, const path_tracing::Material& material);
+        void removeMesh(MeshHandle handle);
+        void clearScene();
+        // Uploads a scene loaded in the background without disturbing the current one. The swap happens at the
+        // start of the first frame after the uploads are done, the returned handles are valid from then on.
+        std::vector<MeshHandle> stageScene(const path_tracing::SceneData& scene);
+        bool hasStagedScene() const { return stagedScene_.has_value(); }
         void uploadEnvMap(const std::string& path);
+        // Keeps the environment on the device after it is replaced, switching back to it later skips the decoding,
+        // the upload and the cube map conversion. Swapped in at the start of the next frame.
+        void useResidentEnvironment(const std::string& path);
+        // textures stay resident once uploaded, later scenes do not need to decode them again
+        bool hasTexture(const std::string& path) const { return textureIndices_.contains(path); }
+        // Device memory per category and per heap, queried from VMA and VK_EXT_memory_budget when available
+        MemoryReport memoryReport() const;
+        void logMemoryReport() const;
         void resetAccumulation();
+        // For camera motion: keeps the accumulation of the surfaces that stay visible by reprojecting it, resets it
+        // when the reprojection is off
+        void reprojectAccumulation();
+        // Renders the given number of frames with each path tracing mode and compares their GPU times
+        void startBenchmark(uint32_t framesPerMode);
+        bool isBenchmarking() const { return benchmark_.has_value(); }
+        const std::string& benchmarkResult() const { return benchmarkResult_; }
+        // GPU time of one accumulation pass of the path tracer, smoothed over the last frames
+        double pathTracingTimeMs() const { return pathTracingTimeMs_; }
+        // accumulation passes recorded into the last frame
+        uint32_t passesPerFrame() const { return passesPerFrame_; }
+        bool rayQuerySupported() const { return rayQuerySupported_; }
+        // one traced pixel per interleave x interleave block, 1 at full resolution
+        uint32_t interleave() const { return ptPushConstants_.interleave; }
+        // frames accumulated since the last reset
+        uint32_t accumulatedFrames() const { return ptPushConstants_.frame; }
+        // Waits for the frames in flight and copies the accumulated output back, available once a frame was
+        // rendered. Indices of the environment read as -1.
+        ImageReadback readOutput(Aov aov);
+        // The tone mapped result as shown in the window, linear rgb in [0, 1]. Available once a frame was rendered.
+        ImageReadback readDisplay();
+        // Renders the accumulated radiance of the camera tile by tile through the draw image and streams it to a
+        // file, the device memory does not grow with the output size. Blocks until done, needs a rendered frame.
+        void renderTiled(const core::Camera& camera, const TiledRenderSettings& settings);
+        // Accumulates the samples [sampleOffset, sampleOffset + samples) of the draw image sized window at origin of
+        // an output of the given size. Returns rgba floats with the sample count in alpha, needs a rendered frame.
+        std::vector<float> renderRegion(const core::Camera& camera, VkExtent2D output, glm::uvec2 origin,
+                                        uint32_t sampleOffset, uint32_t samples);
         void cleanup();
 
         path_tracing::PushConstants ptPushConstants_{};
         PostProcessingPushConstants ppPushConstants_{};
+        // Edge-aware a-trous filter between the path tracing and the post processing, the accumulation is untouched
+        bool denoising_ = false;
+        uint32_t denoisingIterations_ = 5;
+        DenoisingPushConstants dnPushConstants_{};
+        // Not combined with adaptive sampling, its variance estimate cannot be reprojected
+        bool temporalReprojection_ = true;
+        ReprojectionPushConstants rpPushConstants_{};
+        // While the camera moves only part of the pixels is traced, as many as fit the target time of the path
+        // tracing, the others are filled in from their neighbours. Refines back to every pixel once it stops.
+        bool dynamicResolution_ = true;
+        float targetFrameTimeMs_ = 16.0f;
+        // A still camera gets as many accumulation passes per present as fit targetFrameTimeMs_
+        bool timeBudget_ = true;
+        uint32_t maxPassesPerFrame_ = 32;
+        // Bakes the settings into a specialized path tracing pipeline, turning it off allows comparing against
+        // the generic one
+        bool specializeShaders_ = true;
+        // Replaces the BSDF sampling with a plain GGX reflection and lights everything with a white environment
+        bool brdfDebugging_ = false;
+        PathTracingMode pathTracingMode_ = PathTracingMode::Megakernel;
+        // enough invocations to fill the device, the GPU does not tell how many it runs concurrently
+        uint32_t persistentWorkgroups_ = 256;
+        // Traces through acceleration structures with ray queries instead of the software BVH when supported
+        bool rayQuery_ = true;
+        // Megakernel only: tiles whose error estimate fell below ptPushConstants_.adaptiveThreshold are skipped
+        bool adaptiveSampling_ = false;
 
     private:
+        // everything sized by swapchainExtent_, shared by the windowed and the headless renderer
+        void initResources();
         void initVulkan(GLFWwindow* window);
         void initImguiBackend(GLFWwindow* wwindow);
         void initGlobalResources();
         void initPathTracing();
         void initPostProcessing();
+        void initDenoising();
+        void initReprojection();
         void initEquiToCubeMap();
+        void createPipelineCache();
+        VkPipeline createComputePipeline(const std::string& shaderPath, VkPipelineLayout layout,
+                                         const VkSpecializationInfo* specialization = nullptr) const;
+        VkPipeline createPathTracingPipeline(path_tracing::ShaderVariant variant) const;
+        // Builds the compute pipelines of all passes, their layouts have to exist already
+        void createPipelines();
+        path_tracing::ShaderVariant currentShaderVariant(path_tracing::PathTracingKernel kernel) const;
+        // The variant matching the current settings when it is compiled, the generic one until then
+        VkPipeline pathTracingPipeline(path_tracing::PathTracingKernel kernel);
         void createInstance(GLFWwindow* window);
         bool isDeviceSuitable(VkPhysicalDevice device);
         void findQueueFamily(VkPhysicalDevice device);
         void pickPhysicalDevice();
+        std::vector<const char*> requiredDeviceExtensions() const;
         void createLogicaldevice();
         static VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
         static VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
@@ -86,30 +328,113 @@ namespace renderer
         void createVmaAllocator();
         void createCommands();
         void createSyncs();
+        void createUploadManager();
+        void initSceneHeap();
+        AllocatedBuffer createSceneHeapBuffer(VkDeviceSize size);
+        void growSceneHeap(VkDeviceSize capacity);
+        SceneHeap::Range allocateSceneRange(VkDeviceSize size, VkDeviceSize alignment);
+        void releaseSceneRange(const SceneHeap::Range& range);
+        SceneHeap::Range uploadSceneRange(const void* data, VkDeviceSize size, VkDeviceSize alignment);
+        void uploadGeometry(SceneMesh& sceneMesh, const path_tracing::Geometry& geometry);
+        void uploadMaterial(SceneMesh& sceneMesh, const path_tracing::Material& material,
+                            const TextureDataMap* decodedTextures = nullptr);
+        void releaseMeshRanges(const SceneMesh& sceneMesh);
+        bool useRayQuery() const { return rayQuerySupported_ && rayQuery_; }
+        // Creates the acceleration structure and records its build, the scratch memory is retired with the frame
+        AccelerationStructure recordAccelerationStructureBuild(VkCommandBuffer cmd, VkAccelerationStructureTypeKHR type,
+                                                               const VkAccelerationStructureGeometryKHR& geometry,
+                                                               uint32_t primitiveCount);
+        // BLAS of meshes that have none yet and the TLAS over all of them
+        void recordAccelerationStructureBuilds(VkCommandBuffer cmd);
+        void retireAccelerationStructure(const AccelerationStructure& accelerationStructure);
+        int textureIndex(const std::optional<std::string>& path, bool sRGB = false,
+                         const TextureDataMap* decodedTextures = nullptr);
+        void commitScene();
+        void discardStagedScene();
+        void swapStagedScene();
+        static VkDeviceSize geometrySize(const path_tracing::Geometry& geometry);
+        VkDeviceSize estimateSceneSize(const path_tracing::SceneData& scene) const;
+        // Prints a warning when the additional bytes would bring the device local heaps close to their budget
+        bool warnIfOverBudget(VkDeviceSize additional, const char* operation) const;
+        Environment createEnvironment(const path_tracing::EnvironmentData& data);
+        void applyEnvironment(const Environment& environment);
+        void destroyEnvironment(const Environment& environment);
+        bool isResidentEnvironment(VkImage cubeMap) const;
         AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
         void destroyBuffer(const AllocatedBuffer& buffer);
         AllocatedImage createImage(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped);
-        AllocatedImage createImage(stbi_uc* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage,
+        AllocatedImage createImage(const stbi_uc* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage,
                                    bool mipmapped);
         AllocatedImage createCubemap(VkExtent3D size, VkFormat format, VkImageUsageFlags usage);
         void destroyImage(const AllocatedImage& image);
+        // Destroys a resource once the frames recorded so far and the uploads submitted so far are done with it
+        void retire(std::function<void()>&& function);
+        void flushRetiredResources(bool all);
         void immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function);
+        // Copies the whole image into a host visible buffer once the frames in flight are done writing it
+        AllocatedBuffer readbackImage(const AllocatedImage& image, VkImageLayout layout, VkDeviceSize texelSize);
+        // swaps in the staged scene once uploaded, applies a pending environment and commits scene edits
+        void commitPendingChanges();
+        // work waiting for freshly acquired uploads and the acceleration structure builds
+        void recordPendingWork(VkCommandBuffer cmd);
+        // Runs the frame boundary of draw() for tiled and region renders, which record their own submissions. Waits
+        // for the device and for the pending uploads.
+        void settlePendingChanges();
         void draw();
-        void updateGlobalDescriptors(const core::Camera& camera) const;
+        // camera of the draw image sized window at origin of the output
+        CameraUniform regionCamera(const core::Camera& camera, VkExtent2D output, glm::uvec2 origin) const;
+        // Accumulates the frames of the region starting at firstFrame, 0 starts from scratch. Copies the draw image
+        // into the readback buffer unless it is VK_NULL_HANDLE.
+        void recordRegion(VkCommandBuffer cmd, const CameraUniform& camera, uint32_t firstFrame, uint32_t frames,
+                          VkBuffer readback);
+        // records and submits the command buffer of the frame slot, signaling its fence once done
+        void submitOnFrame(uint32_t slot, const std::function<void(VkCommandBuffer cmd)>& record);
+        // binds the path tracing sets and accumulates one frame per pass
+        void recordAccumulationPasses(VkCommandBuffer cmd, uint32_t passes);
+        void recordMegakernel(VkCommandBuffer cmd);
+        // Sized for the draw image, created on first use of adaptive sampling
+        void createAdaptiveBuffer(VkCommandBuffer cmd);
+        // Sized for one path per pixel, created on first use of the wavefront mode
+        void createWavefrontBuffer(VkCommandBuffer cmd);
+        void resetWavefrontQueues(VkCommandBuffer cmd, uint32_t firstQueue, uint32_t queueCount) const;
+        void recordWavefront(VkCommandBuffer cmd);
+        void recordPersistentThreads(VkCommandBuffer cmd);
+        void recordDenoising(VkCommandBuffer cmd);
+        // copies the accumulation of the previous camera aside before the path tracer restarts it
+        void recordHistoryCopy(VkCommandBuffer cmd);
+        void recordReprojection(VkCommandBuffer cmd);
+        void updateDynamicResolution();
+        uint32_t budgetedPasses() const;
+        void recordFill(VkCommandBuffer cmd);
+        void createTimestampQueries();
+        void readTimestamps();
+        void updateBenchmark();
+        // prepares the camera of the next frame, draw() writes it into its slot once the slot is free
+        void updateGlobalDescriptors(const core::Camera& camera);
+        // dynamic offset of the camera slot of the current frame
+        uint32_t cameraOffset() const;
         void drawImgui(VkCommandBuffer cmd, VkImageView targetImageView);
 
         uint32_t frameNumber_ = 0;
+        bool headless_ = false;
         VkInstance instance_ = VK_NULL_HANDLE;
         VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
         VkDevice device_ = VK_NULL_HANDLE;
         VkQueue queue_ = VK_NULL_HANDLE;
         std::optional<uint32_t> queueFamily_;
+        VkQueue transferQueue_ = VK_NULL_HANDLE;
+        std::optional<uint32_t> transferQueueFamily_;
         VkSurfaceKHR surface_ = VK_NULL_HANDLE;
         VkSwapchainKHR swapchain_ = VK_NULL_HANDLE;
         std::vector<VkImage> swapchainImages_;
         std::vector<VkImageView> swapchainImageViews_;
         VkFormat swapchainFormat_ = VK_FORMAT_UNDEFINED;
+        // size of every render target, the requested output size when headless
         VkExtent2D swapchainExtent_ = {0, 0};
+        bool memoryBudgetSupported_ = false;
+        bool rayQuerySupported_ = false;
+        vk_utils::AccelerationStructureFunctions accelerationStructureFunctions_;
+        VkDeviceSize scratchAlignment_ = 1;
 
         VmaAllocator allocator_{};
         vk_utils::DescriptorAllocator globalDescriptorAllocator_{};
@@ -117,16 +442,67 @@ namespace renderer
         GlobalResources globalResources_;
         AllocatedImage drawImage_;
         AllocatedImage postProcessImage_;
-        path_tracing::SceneBuffers sceneBuffers_;
+        AovImages aovImages_;
+        // ping-pong targets of the denoiser, the result ends up in the first one
+        std::array<AllocatedImage, 2> filterImages_;
+        HistoryImages historyImages_;
+        bool reprojectHistory_ = false;
+        glm::mat4 previousView_{1.0f};
+        glm::mat4 previousProj_{1.0f};
+        CameraUniform cameraUniform_{};
+        bool cameraMoved_ = false;
+        // interleaved frames left until every pixel of the blocks was traced since the camera stopped
+        uint32_t refinementFrames_ = 0;
+        // smoothed GPU time of the path tracing over every pixel, extrapolated from interleaved frames
+        double fullResolutionTimeMs_ = 0.0;
+        uint32_t passesPerFrame_ = 1;
+        SceneHeap sceneHeap_;
+        // ordered by handle so that mesh indices on the GPU follow insertion order
+        std::map<MeshHandle, SceneMesh> sceneMeshes_;
+        MeshHandle nextMeshHandle_ = 0;
+        SceneHeap::Range sceneMeshInfoRange_{};
+        SceneHeap::Range sceneLightRange_{};
+        SceneHeap::Range sceneHeaderRange_{};
+        SceneHeap::Range sceneSobolRange_{};
+        bool sceneDirty_ = false;
+        AccelerationStructure tlas_;
+        bool tlasDirty_ = false;
+        std::optional<StagedScene> stagedScene_;
+        std::optional<Environment> pendingEnvironment_;
+        // keyed by path, the equirectangular image is dropped once converted
+        std::unordered_map<std::string, Environment> residentEnvironments_;
+        uint32_t activeEnvironment_ = 0;
         std::vector<AllocatedImage> textures_;
+        std::unordered_map<std::string, uint32_t> textureIndices_;
 
         PipelineLayouts pipelineLayouts_;
         Pipelines pipelines_;
+        VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+        std::map<path_tracing::ShaderVariant, VkPipeline> pathTracingVariants_;
+        std::optional<PendingShaderVariant> pendingPathTracingVariant_;
+        AllocatedBuffer wavefrontBuffer_;
+        AllocatedBuffer workCounterBuffer_;
+        AllocatedBuffer adaptiveBuffer_;
+        VkDeviceAddress adaptiveAddress_ = 0;
+        std::array<VkDeviceSize, 2> adaptiveTileListOffsets_ = {};
+        uint32_t adaptiveTileList_ = 0; // list traced by the next frame
+        // timestamps around the path tracing passes, read back once the frame slot comes around again
+        std::array<FrameTiming, FRAME_OVERLAP> frameTimings_;
+        float timestampPeriod_ = 0.0f; // 0 when the graphics queue has no timestamps
+        double pathTracingTimeMs_ = 0.0;
+        std::optional<Benchmark> benchmark_;
+        std::string benchmarkResult_;
         DescriptorLayouts descriptorLayouts_;
         DescriptorSets descriptorSets_;
 
         ImmediateHandles immediateHandles_;
+        UploadManager uploadManager_;
+        // frames wait on this value and acquire what was released up to it, staged uploads are not included
+        uint64_t uploadWaitValue_ = 0;
+        // graphics work depending on uploads (e.g. cube map conversion), recorded at the start of the next frame
+        std::vector<std::function<void(VkCommandBuffer cmd)>> pendingGraphicsWork_;
         DeletionQueue deletionQueue_;
+        std::deque<RetiredResource> retiredResources_;
         FrameData frames_[FRAME_OVERLAP];
         FrameData& getCurrentFrame() { return frames_[frameNumber_ % FRAME_OVERLAP]; }
     };
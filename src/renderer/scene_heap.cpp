@@ -0,0 +1,77 @@
+#include "scene_heap.h"
+
+#include <algorithm>
+
+namespace renderer
+{
+    void SceneHeap::reset(VkDeviceSize capacity)
+    {
+        freeBlocks_.clear();
+        capacity_ = capacity;
+        used_ = 0;
+        if (capacity_ > 0)
+            freeBlocks_.emplace(0, capacity_);
+    }
+
+    std::optional<SceneHeap::Range> SceneHeap::allocate(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        // empty streams still get a valid offset
+        size = (std::max<VkDeviceSize>(size, 1) + alignment - 1) / alignment * alignment;
+
+        for (auto it = freeBlocks_.begin(); it != freeBlocks_.end(); ++it)
+        {
+            const VkDeviceSize blockOffset = it->first;
+            const VkDeviceSize blockEnd = it->first + it->second;
+            const VkDeviceSize offset = (blockOffset + alignment - 1) / alignment * alignment;
+            if (offset + size > blockEnd)
+                continue;
+
+            // keep what is left on both sides of the range
+            freeBlocks_.erase(it);
+            if (offset > blockOffset)
+                freeBlocks_.emplace(blockOffset, offset - blockOffset);
+            if (offset + size < blockEnd)
+                freeBlocks_.emplace(offset + size, blockEnd - (offset + size));
+
+            used_ += size;
+            return Range{offset, size};
+        }
+        return std::nullopt;
+    }
+
+    void SceneHeap::free(const Range& range)
+    {
+        if (range.size == 0)
+            return;
+        used_ -= range.size;
+
+        auto [it, inserted] = freeBlocks_.emplace(range.offset, range.size);
+        // merge with the following block
+        auto next = std::next(it);
+        if (next != freeBlocks_.end() && it->first + it->second == next->first)
+        {
+            it->second += next->second;
+            freeBlocks_.erase(next);
+        }
+        // merge with the preceding block
+        if (it != freeBlocks_.begin())
+        {
+            auto prev = std::prev(it);
+            if (prev->first + prev->second == it->first)
+            {
+                prev->second += it->second;
+                freeBlocks_.erase(it);
+            }
+        }
+    }
+
+    void SceneHeap::grow(VkDeviceSize capacity)
+    {
+        if (capacity <= capacity_)
+            return;
+        free({capacity_, capacity - capacity_});
+        // the new space was never allocated, do not count it as released
+        used_ += capacity - capacity_;
+        capacity_ = capacity;
+    }
+} // renderer
@@ -0,0 +1,38 @@
+#pragma once
+#include "types.h"
+
+#include <map>
+#include <optional>
+
+namespace renderer
+{
+    // Sub-allocates the ranges of every scene stream from a single device buffer.
+    // Only the bookkeeping lives here, the renderer creates the buffer and moves it when the heap grows.
+    class SceneHeap
+    {
+    public:
+        struct Range
+        {
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+        };
+
+        void reset(VkDeviceSize capacity);
+        // First fit in the free-list, returns nothing when the heap has to grow
+        std::optional<Range> allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+        void free(const Range& range);
+        // Extends the heap with free space at its end, existing ranges keep their offsets
+        void grow(VkDeviceSize capacity);
+        VkDeviceSize capacity() const { return capacity_; }
+        VkDeviceSize used() const { return used_; }
+
+        AllocatedBuffer buffer{};
+        VkDeviceAddress address = 0;
+
+    private:
+        // offset -> size, ordered so that neighbouring blocks can be merged back
+        std::map<VkDeviceSize, VkDeviceSize> freeBlocks_;
+        VkDeviceSize capacity_ = 0;
+        VkDeviceSize used_ = 0;
+    };
+} // renderer
@@ -0,0 +1,351 @@
+#include "upload_manager.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "vk_utils/vk_infos.h"
+
+namespace renderer
+{
+    void UploadManager::init(VkDevice device, VmaAllocator allocator, VkQueue transferQueue, uint32_t transferFamily,
+                             uint32_t graphicsFamily)
+    {
+        device_ = device;
+        allocator_ = allocator;
+        queue_ = transferQueue;
+        transferFamily_ = transferFamily;
+        graphicsFamily_ = graphicsFamily;
+
+        VkCommandPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = transferFamily_,
+        };
+        VK_CHECK(vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool_),
+                 "Failed to create upload command pool!");
+
+        VkSemaphoreTypeCreateInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        };
+        VkSemaphoreCreateInfo semaphoreInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &timelineInfo,
+        };
+        VK_CHECK(vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &timeline_),
+                 "Failed to create upload timeline semaphore!");
+
+        VkBufferCreateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = RING_SIZE,
+            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        };
+        VmaAllocationCreateInfo vmaallocInfo = {
+            .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+        };
+        VK_CHECK(vmaCreateBuffer(allocator_, &bufferInfo, &vmaallocInfo, &ring_.buffer, &ring_.allocation,
+                     &ring_.info), "Could not create upload ring buffer!");
+    }
+
+    VkCommandBuffer UploadManager::commandBuffer()
+    {
+        if (recording_ >= 0)
+            return batches_[recording_].cmd;
+
+        // reuse a command buffer whose submission is done, otherwise grow the pool
+        uint64_t completed = 0;
+        vkGetSemaphoreCounterValue(device_, timeline_, &completed);
+        auto it = std::find_if(batches_.begin(), batches_.end(), [&](const Batch& b) { return b.value <= completed; });
+        if (it == batches_.end())
+        {
+            Batch batch{};
+            VkCommandBufferAllocateInfo allocInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = commandPool_,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+            };
+            VK_CHECK(vkAllocateCommandBuffers(device_, &allocInfo, &batch.cmd),
+                     "Failed to allocate upload command buffer!");
+            batches_.push_back(batch);
+            it = batches_.end() - 1;
+        }
+        recording_ = static_cast<int>(it - batches_.begin());
+
+        VK_CHECK(vkResetCommandBuffer(it->cmd, 0), "");
+        VkCommandBufferBeginInfo cmdBeginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        VK_CHECK(vkBeginCommandBuffer(it->cmd, &cmdBeginInfo), "Could not begin upload command buffer!");
+        return it->cmd;
+    }
+
+    VkDeviceSize UploadManager::reserve(VkDeviceSize size)
+    {
+        // 16 bytes keeps every copy aligned for all the texel sizes we use
+        VkDeviceSize start = (ringHead_ + 15) & ~VkDeviceSize(15);
+        // a copy never wraps around the end of the ring
+        if (start % RING_SIZE + size > RING_SIZE)
+            start += RING_SIZE - start % RING_SIZE;
+
+        while (start + size - ringTail_ > RING_SIZE)
+        {
+            // the ring is full of copies that were not even submitted yet
+            if (ringRegions_.empty())
+            {
+                flush();
+                continue;
+            }
+            const RingRegion region = ringRegions_.front();
+            ringRegions_.pop_front();
+            wait(region.value);
+            ringTail_ = region.end;
+        }
+
+        ringHead_ = start + size;
+        return start % RING_SIZE;
+    }
+
+    void UploadManager::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+                                     bool transferOwnership)
+    {
+        for (VkDeviceSize done = 0; done < size;)
+        {
+            const VkDeviceSize chunk = std::min(size - done, MAX_CHUNK_SIZE);
+            const VkDeviceSize srcOffset = reserve(chunk);
+            memcpy(static_cast<char*>(ring_.info.pMappedData) + srcOffset, static_cast<const char*>(data) + done,
+                   chunk);
+
+            VkBufferCopy copy = {.srcOffset = srcOffset, .dstOffset = dstOffset + done, .size = chunk};
+            vkCmdCopyBuffer(commandBuffer(), ring_.buffer, dst, 1, &copy);
+            done += chunk;
+        }
+
+        VkBufferMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = dst,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        };
+        if (hasDedicatedQueue() && transferOwnership)
+        {
+            // release on the transfer queue, the matching acquire is recorded on the graphics queue
+            barrier.srcQueueFamilyIndex = transferFamily_;
+            barrier.dstQueueFamilyIndex = graphicsFamily_;
+            VkBufferMemoryBarrier2 acquire = barrier;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+            barrier.dstAccessMask = VK_ACCESS_2_NONE;
+            acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+            acquire.srcAccessMask = VK_ACCESS_2_NONE;
+            pendingBufferAcquires_.push_back({0, acquire});
+        }
+
+        VkDependencyInfo depInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .bufferMemoryBarrierCount = 1,
+            .pBufferMemoryBarriers = &barrier,
+        };
+        vkCmdPipelineBarrier2(commandBuffer(), &depInfo);
+    }
+
+    void UploadManager::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size)
+    {
+        // earlier uploads into src have to land before it is read, later ones into dst must not be overwritten
+        VkMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        };
+        VkDependencyInfo depInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &barrier,
+        };
+        vkCmdPipelineBarrier2(commandBuffer(), &depInfo);
+
+        VkBufferCopy copy = {.srcOffset = 0, .dstOffset = 0, .size = size};
+        vkCmdCopyBuffer(commandBuffer(), src, dst, 1, &copy);
+
+        vkCmdPipelineBarrier2(commandBuffer(), &depInfo);
+    }
+
+    void UploadManager::uploadImage(VkImage dst, VkExtent3D extent, uint32_t texelSize, const void* data,
+                                    VkImageLayout finalLayout)
+    {
+        VkImageMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+            .srcAccessMask = VK_ACCESS_2_NONE,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = dst,
+            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
+        };
+        VkDependencyInfo depInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .imageMemoryBarrierCount = 1,
+            .pImageMemoryBarriers = &barrier,
+        };
+        vkCmdPipelineBarrier2(commandBuffer(), &depInfo);
+
+        // large images are copied in bands of full rows so they fit in the ring
+        const VkDeviceSize rowSize = static_cast<VkDeviceSize>(extent.width) * texelSize;
+        const uint32_t rowsPerChunk = static_cast<uint32_t>(std::max<VkDeviceSize>(1, MAX_CHUNK_SIZE / rowSize));
+        for (uint32_t row = 0; row < extent.height; row += rowsPerChunk)
+        {
+            const uint32_t rowCount = std::min(rowsPerChunk, extent.height - row);
+            const VkDeviceSize srcOffset = reserve(rowSize * rowCount);
+            memcpy(static_cast<char*>(ring_.info.pMappedData) + srcOffset,
+                   static_cast<const char*>(data) + rowSize * row, rowSize * rowCount);
+
+            VkBufferImageCopy copyRegion = {
+                .bufferOffset = srcOffset,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                .imageOffset = {0, static_cast<int32_t>(row), 0},
+                .imageExtent = {extent.width, rowCount, 1},
+            };
+            vkCmdCopyBufferToImage(commandBuffer(), ring_.buffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                                   &copyRegion);
+        }
+
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = finalLayout;
+        if (hasDedicatedQueue())
+        {
+            // the layout transition happens once, as part of the release/acquire pair
+            barrier.srcQueueFamilyIndex = transferFamily_;
+            barrier.dstQueueFamilyIndex = graphicsFamily_;
+            VkImageMemoryBarrier2 acquire = barrier;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+            barrier.dstAccessMask = VK_ACCESS_2_NONE;
+            acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+            acquire.srcAccessMask = VK_ACCESS_2_NONE;
+            pendingImageAcquires_.push_back({0, acquire});
+        }
+        vkCmdPipelineBarrier2(commandBuffer(), &depInfo);
+    }
+
+    uint64_t UploadManager::flush()
+    {
+        if (recording_ < 0)
+            return lastSubmitted_;
+
+        Batch& batch = batches_[recording_];
+        VK_CHECK(vkEndCommandBuffer(batch.cmd), "Could not record upload command buffer!");
+
+        batch.value = lastSubmitted_ + 1;
+        VkSemaphoreSubmitInfo signalInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = timeline_,
+            .value = batch.value,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        };
+        VkCommandBufferSubmitInfo cmdInfo = vk_utils::commandBufferSubmitInfo(batch.cmd);
+        VkSubmitInfo2 submitInfo = vk_utils::submitInfo(&cmdInfo, &signalInfo, nullptr);
+        VK_CHECK(vkQueueSubmit2(queue_, 1, &submitInfo, VK_NULL_HANDLE), "Could not submit uploads!");
+
+        lastSubmitted_ = batch.value;
+        ringRegions_.push_back({lastSubmitted_, ringHead_});
+        for (auto& acquire : pendingBufferAcquires_)
+            acquire.value = acquire.value == 0 ? lastSubmitted_ : acquire.value;
+        for (auto& acquire : pendingImageAcquires_)
+            acquire.value = acquire.value == 0 ? lastSubmitted_ : acquire.value;
+        recording_ = -1;
+        return lastSubmitted_;
+    }
+
+    void UploadManager::recordAcquireBarriers(VkCommandBuffer cmd, uint64_t value)
+    {
+        flush();
+
+        // resources released by later batches (e.g. a scene prepared in the background) are acquired by a later frame
+        std::vector<VkBufferMemoryBarrier2> bufferAcquires;
+        std::vector<VkImageMemoryBarrier2> imageAcquires;
+        std::erase_if(pendingBufferAcquires_, [&](const PendingAcquire<VkBufferMemoryBarrier2>& acquire)
+        {
+            if (acquire.value > value)
+                return false;
+            bufferAcquires.push_back(acquire.barrier);
+            return true;
+        });
+        std::erase_if(pendingImageAcquires_, [&](const PendingAcquire<VkImageMemoryBarrier2>& acquire)
+        {
+            if (acquire.value > value)
+                return false;
+            imageAcquires.push_back(acquire.barrier);
+            return true;
+        });
+        if (bufferAcquires.empty() && imageAcquires.empty())
+            return;
+
+        VkDependencyInfo depInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferAcquires.size()),
+            .pBufferMemoryBarriers = bufferAcquires.data(),
+            .imageMemoryBarrierCount = static_cast<uint32_t>(imageAcquires.size()),
+            .pImageMemoryBarriers = imageAcquires.data(),
+        };
+        vkCmdPipelineBarrier2(cmd, &depInfo);
+    }
+
+    VkSemaphoreSubmitInfo UploadManager::waitInfo(VkPipelineStageFlags2 stageMask, uint64_t value) const
+    {
+        VkSemaphoreSubmitInfo info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = timeline_,
+            .value = value,
+            .stageMask = stageMask,
+        };
+        return info;
+    }
+
+    bool UploadManager::isComplete(uint64_t value) const
+    {
+        uint64_t completed = 0;
+        vkGetSemaphoreCounterValue(device_, timeline_, &completed);
+        return completed >= value;
+    }
+
+    void UploadManager::wait(uint64_t value) const
+    {
+        VkSemaphoreWaitInfo waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &timeline_,
+            .pValues = &value,
+        };
+        VK_CHECK(vkWaitSemaphores(device_, &waitInfo, UINT64_MAX), "Failed to wait for uploads!");
+    }
+
+    void UploadManager::cleanup()
+    {
+        flush();
+        wait(lastSubmitted_);
+        vmaDestroyBuffer(allocator_, ring_.buffer, ring_.allocation);
+        for (const auto& batch : batches_)
+            vkFreeCommandBuffers(device_, commandPool_, 1, &batch.cmd);
+        vkDestroyCommandPool(device_, commandPool_, nullptr);
+        vkDestroySemaphore(device_, timeline_, nullptr);
+    }
+} // renderer
@@ -0,0 +1,89 @@
+#pragma once
+#include "types.h"
+#include "constants.h"
+
+#include <deque>
+#include <vector>
+
+namespace renderer
+{
+    // Streams data into device local resources through a persistently mapped staging ring.
+    // Copies are recorded on the transfer queue (a dedicated family when the device has one) and their completion
+    // is tracked with a timeline semaphore, so the caller never waits unless the ring is full.
+    class UploadManager
+    {
+        static constexpr VkDeviceSize RING_SIZE = 64 * 1024 * 1024;
+        static constexpr VkDeviceSize MAX_CHUNK_SIZE = RING_SIZE / 4;
+
+        struct Batch
+        {
+            VkCommandBuffer cmd = VK_NULL_HANDLE;
+            uint64_t value = 0;
+        };
+
+        struct RingRegion
+        {
+            uint64_t value;
+            VkDeviceSize end;
+        };
+
+        // value stays 0 until the batch releasing the resource is submitted
+        template <typename Barrier>
+        struct PendingAcquire
+        {
+            uint64_t value;
+            Barrier barrier;
+        };
+
+    public:
+        void init(VkDevice device, VmaAllocator allocator, VkQueue transferQueue, uint32_t transferFamily,
+                  uint32_t graphicsFamily);
+        // The buffer is handed over to the graphics family once copied unless it was created with concurrent sharing
+        void uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+                          bool transferOwnership = true);
+        // Device side copy ordered with the uploads around it, used to move buffers that have to grow
+        void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+        // Uploads the first mip of a 2D image, tightly packed rows are expected
+        void uploadImage(VkImage dst, VkExtent3D extent, uint32_t texelSize, const void* data,
+                         VkImageLayout finalLayout);
+        // Submits everything recorded so far and returns the timeline value signaled once it is done
+        uint64_t flush();
+        // Flushes pending copies and records the acquire side of the ownership transfers on a graphics command buffer.
+        // Only resources released up to value are acquired, the submission has to wait on that same value.
+        void recordAcquireBarriers(VkCommandBuffer cmd, uint64_t value);
+        // Graphics submissions using resources uploaded up to value have to wait on this
+        VkSemaphoreSubmitInfo waitInfo(VkPipelineStageFlags2 stageMask, uint64_t value) const;
+        bool isComplete(uint64_t value) const;
+        void wait(uint64_t value) const;
+        uint64_t lastSubmittedValue() const { return lastSubmitted_; }
+        bool hasDedicatedQueue() const { return transferFamily_ != graphicsFamily_; }
+        VkDeviceSize stagingSize() const { return ring_.info.size; }
+        void cleanup();
+
+    private:
+        VkCommandBuffer commandBuffer();
+        VkDeviceSize reserve(VkDeviceSize size);
+
+        VkDevice device_ = VK_NULL_HANDLE;
+        VmaAllocator allocator_ = VK_NULL_HANDLE;
+        VkQueue queue_ = VK_NULL_HANDLE;
+        uint32_t transferFamily_ = 0;
+        uint32_t graphicsFamily_ = 0;
+
+        VkCommandPool commandPool_ = VK_NULL_HANDLE;
+        std::vector<Batch> batches_;
+        int recording_ = -1;
+
+        VkSemaphore timeline_ = VK_NULL_HANDLE;
+        uint64_t lastSubmitted_ = 0;
+
+        AllocatedBuffer ring_{};
+        // head and tail grow forever, the physical offset is the position modulo RING_SIZE
+        VkDeviceSize ringHead_ = 0;
+        VkDeviceSize ringTail_ = 0;
+        std::deque<RingRegion> ringRegions_;
+
+        std::vector<PendingAcquire<VkBufferMemoryBarrier2>> pendingBufferAcquires_;
+        std::vector<PendingAcquire<VkImageMemoryBarrier2>> pendingImageAcquires_;
+    };
+} // renderer
@@ -0,0 +1,42 @@
+#include "vk_acceleration_structure.h"
+#include "vk_compatibility.h"
+
+namespace vk_utils
+{
+    bool isRayQuerySupported(VkPhysicalDevice device)
+    {
+        for (const char* extension : RAY_QUERY_EXTENSIONS)
+        {
+            if (!isDeviceExtensionSupported(device, extension))
+                return false;
+        }
+
+        VkPhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR,
+        };
+        VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
+            .pNext = &rayQueryFeatures,
+        };
+        VkPhysicalDeviceFeatures2 features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &accelerationStructureFeatures,
+        };
+        vkGetPhysicalDeviceFeatures2(device, &features);
+        return accelerationStructureFeatures.accelerationStructure && rayQueryFeatures.rayQuery;
+    }
+
+    void AccelerationStructureFunctions::load(VkDevice device)
+    {
+        create = reinterpret_cast<PFN_vkCreateAccelerationStructureKHR>(
+            vkGetDeviceProcAddr(device, "vkCreateAccelerationStructureKHR"));
+        destroy = reinterpret_cast<PFN_vkDestroyAccelerationStructureKHR>(
+            vkGetDeviceProcAddr(device, "vkDestroyAccelerationStructureKHR"));
+        getBuildSizes = reinterpret_cast<PFN_vkGetAccelerationStructureBuildSizesKHR>(
+            vkGetDeviceProcAddr(device, "vkGetAccelerationStructureBuildSizesKHR"));
+        getDeviceAddress = reinterpret_cast<PFN_vkGetAccelerationStructureDeviceAddressKHR>(
+            vkGetDeviceProcAddr(device, "vkGetAccelerationStructureDeviceAddressKHR"));
+        cmdBuild = reinterpret_cast<PFN_vkCmdBuildAccelerationStructuresKHR>(
+            vkGetDeviceProcAddr(device, "vkCmdBuildAccelerationStructuresKHR"));
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "types.h"
+#include "constants.h"
+
+#include <vector>
+
+namespace vk_utils
+{
+    // Enabled on top of DEVICE_EXTENSIONS when the device can trace with ray queries
+    const std::vector<const char*> RAY_QUERY_EXTENSIONS = {
+        VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
+        VK_KHR_RAY_QUERY_EXTENSION_NAME,
+        VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
+    };
+
+    // Extensions and features of the hardware ray query backend, CPU implementations like lavapipe expose them too
+    bool isRayQuerySupported(VkPhysicalDevice device);
+
+    // Entry points of VK_KHR_acceleration_structure, the loader does not export them
+    struct AccelerationStructureFunctions
+    {
+        PFN_vkCreateAccelerationStructureKHR create = nullptr;
+        PFN_vkDestroyAccelerationStructureKHR destroy = nullptr;
+        PFN_vkGetAccelerationStructureBuildSizesKHR getBuildSizes = nullptr;
+        PFN_vkGetAccelerationStructureDeviceAddressKHR getDeviceAddress = nullptr;
+        PFN_vkCmdBuildAccelerationStructuresKHR cmdBuild = nullptr;
+
+        void load(VkDevice device);
+    };
+}
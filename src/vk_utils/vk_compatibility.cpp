@@ -37,7 +37,7 @@ namespace vk_utils
         return true;
     }
 
-    bool checkDeviceExtensionSupport(VkPhysicalDevice device)
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device, const std::vector<const char*>& extensions)
     {
         uint32_t extensionCount;
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -45,7 +45,7 @@ namespace vk_utils
         std::vector<VkExtensionProperties> availableExtensions(extensionCount);
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-        std::set<std::string> requiredExtensions(DEVICE_EXTENSIONS.begin(), DEVICE_EXTENSIONS.end());
+        std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
         for (const auto& extension : availableExtensions)
         {
@@ -55,6 +55,22 @@ namespace vk_utils
         return requiredExtensions.empty();
     }
 
+    bool isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName)
+    {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto& extension : availableExtensions)
+        {
+            if (strcmp(extensionName, extension.extensionName) == 0)
+                return true;
+        }
+        return false;
+    }
+
     SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice device, VkSurfaceKHR surface)
     {
         SwapchainSupportDetails details;
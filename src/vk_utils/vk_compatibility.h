@@ -14,6 +14,8 @@ namespace vk_utils
     };
 
     bool checkValidationLayerSupport();
-    bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device, const std::vector<const char*>& extensions);
+    // For optional extensions, the required ones are checked by checkDeviceExtensionSupport
+    bool isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName);
     SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
 }
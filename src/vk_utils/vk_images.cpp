@@ -2,6 +2,12 @@
 #include "vk_images.h"
 #include <iostream>
 #include <format>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+
+#include "core/parallel.h"
 
 
 namespace vk_utils
@@ -48,6 +54,26 @@ namespace vk_utils
     }
 
 
+    void memoryBarrier(VkCommandBuffer cmd, VkPipelineStageFlags2 srcStageMask, VkAccessFlags2 srcAccessMask,
+                       VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask)
+    {
+        VkMemoryBarrier2 memoryBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = srcStageMask,
+            .srcAccessMask = srcAccessMask,
+            .dstStageMask = dstStageMask,
+            .dstAccessMask = dstAccessMask,
+        };
+        VkDependencyInfo depInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &memoryBarrier,
+        };
+
+        vkCmdPipelineBarrier2(cmd, &depInfo);
+    }
+
+
     void transitionCubemap(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout,
                            VkImageLayout newLayout)
     {
@@ -130,22 +156,154 @@ namespace vk_utils
         return pixels;
     }
 
-    float* loadHDRTextureData(const std::string& path, VkExtent3D& size)
+    // Decodes the RLE scanlines of a Radiance .hdr into raw RGBE bytes, returns false on unsupported layouts
+    static bool decodeRadianceScanlines(const std::vector<uint8_t>& file, size_t offset, uint32_t width,
+                                        uint32_t height, std::vector<uint8_t>& rgbe)
+    {
+        rgbe.resize(static_cast<size_t>(width) * height * 4);
+        std::vector<uint8_t> channels(static_cast<size_t>(width) * 4);
+
+        for (uint32_t y = 0; y < height; y++)
+        {
+            uint8_t* row = rgbe.data() + static_cast<size_t>(y) * width * 4;
+            if (offset + 4 > file.size())
+                return false;
+
+            const bool newRLE = width >= 8 && width < 0x8000 && file[offset] == 2 && file[offset + 1] == 2 &&
+                ((file[offset + 2] << 8) | file[offset + 3]) == width;
+            if (!newRLE)
+            {
+                // flat scanlines are only supported when the whole image is stored uncompressed
+                const size_t rowSize = static_cast<size_t>(width) * 4;
+                if (offset + rowSize > file.size() || (file[offset] == 1 && file[offset + 1] == 1 && file[offset + 2] == 1))
+                    return false;
+                memcpy(row, file.data() + offset, rowSize);
+                offset += rowSize;
+                continue;
+            }
+            offset += 4;
+
+            // each channel is run length encoded separately
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                uint8_t* channel = channels.data() + static_cast<size_t>(c) * width;
+                uint32_t x = 0;
+                while (x < width)
+                {
+                    if (offset >= file.size())
+                        return false;
+                    uint32_t count = file[offset++];
+                    if (count > 128)
+                    {
+                        count -= 128;
+                        if (x + count > width || offset >= file.size())
+                            return false;
+                        memset(channel + x, file[offset++], count);
+                    }
+                    else
+                    {
+                        if (count == 0 || x + count > width || offset + count > file.size())
+                            return false;
+                        memcpy(channel + x, file.data() + offset, count);
+                        offset += count;
+                    }
+                    x += count;
+                }
+            }
+            for (uint32_t x = 0; x < width; x++)
+            {
+                for (uint32_t c = 0; c < 4; c++)
+                    row[x * 4 + c] = channels[c * width + x];
+            }
+        }
+        return true;
+    }
+
+    std::vector<uint32_t> loadHDRTextureData(const std::string& path, VkExtent3D& size)
     {
         if (!stbi_is_hdr(path.c_str()))
         {
             throw std::runtime_error("Trying to load LDR image as HDR!");
         }
-        int texWidth, texHeight, texChannels;
-        float* pixels = stbi_loadf(path.c_str(), &texWidth, &texHeight, &texChannels, 4);
-        size.width = static_cast<unsigned int>(texWidth);
-        size.height = static_cast<unsigned int>(texHeight);
 
+        std::ifstream stream(path, std::ios::ate | std::ios::binary);
+        if (!stream.is_open())
+        {
+            throw std::runtime_error(std::format("Failed to open HDR image : {} \n", path));
+        }
+        std::vector<uint8_t> file(static_cast<size_t>(stream.tellg()));
+        stream.seekg(0);
+        stream.read(reinterpret_cast<char*>(file.data()), static_cast<std::streamsize>(file.size()));
+
+        // Parse the header, only the standard "-Y height +X width" orientation is decoded by hand
+        size_t offset = 0;
+        auto readLine = [&]()
+        {
+            std::string line;
+            while (offset < file.size() && file[offset] != '\n')
+                line.push_back(static_cast<char>(file[offset++]));
+            offset++;
+            return line;
+        };
+        bool supported = readLine().starts_with("#?");
+        for (std::string line = readLine(); !line.empty() && offset < file.size(); line = readLine())
+        {
+            if (line.starts_with("FORMAT=") && line != "FORMAT=32-bit_rle_rgbe")
+                supported = false;
+        }
+        int width = 0, height = 0;
+        const std::string resolution = readLine();
+        if (sscanf(resolution.c_str(), "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0)
+            supported = false;
+
+        std::vector<uint8_t> rgbe;
+        if (supported)
+            supported = decodeRadianceScanlines(file, offset, width, height, rgbe);
+
+        std::vector<uint32_t> packed;
+        if (supported)
+        {
+            size.width = static_cast<unsigned int>(width);
+            size.height = static_cast<unsigned int>(height);
+            packed.resize(static_cast<size_t>(width) * height);
+
+            // RGBE to shared exponent, rows are independent so they are split across threads
+            core::parallelFor(size.height, [&](uint32_t begin, uint32_t end)
+            {
+                for (size_t i = static_cast<size_t>(begin) * size.width; i < static_cast<size_t>(end) * size.width; i++)
+                {
+                    const uint8_t* texel = &rgbe[i * 4];
+                    glm::vec3 color(0.0f);
+                    if (texel[3] != 0)
+                    {
+                        const float f = std::ldexp(1.0f, texel[3] - (128 + 8));
+                        color = glm::vec3(texel[0], texel[1], texel[2]) * f;
+                    }
+                    packed[i] = glm::packF3x9_E1x5(color);
+                }
+            });
+            return packed;
+        }
+
+        // Unusual layouts are left to stb, only the packing is parallel then
+        int texWidth, texHeight, texChannels;
+        float* pixels = stbi_loadf(path.c_str(), &texWidth, &texHeight, &texChannels, 3);
         if (!pixels)
         {
             throw std::runtime_error("failed to load texture image!");
         }
-        return pixels;
+        size.width = static_cast<unsigned int>(texWidth);
+        size.height = static_cast<unsigned int>(texHeight);
+        packed.resize(static_cast<size_t>(texWidth) * texHeight);
+
+        core::parallelFor(size.height, [&](uint32_t begin, uint32_t end)
+        {
+            for (size_t i = static_cast<size_t>(begin) * size.width; i < static_cast<size_t>(end) * size.width; i++)
+                packed[i] = glm::packF3x9_E1x5(glm::vec3(pixels[i * 3], pixels[i * 3 + 1], pixels[i * 3 + 2]));
+        });
+        stbi_image_free(pixels);
+
+        return packed;
     }
 
     void freeImageData(void* data)
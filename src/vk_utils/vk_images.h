@@ -1,17 +1,22 @@
 #pragma once
 #include "types.h"
 #include <string>
+#include <vector>
 #include <stb_image.h>
 
 namespace vk_utils
 {
     VkImageSubresourceRange getImageSubresourceRange(VkImageAspectFlags aspectMask);
     void transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout);
+    // Global memory barrier, used between compute passes sharing buffers
+    void memoryBarrier(VkCommandBuffer cmd, VkPipelineStageFlags2 srcStageMask, VkAccessFlags2 srcAccessMask,
+                       VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask);
     void transitionCubemap(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout);
     void copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize,
                           VkExtent2D dstSize);
     stbi_uc* loadTextureData(const std::string& path, VkExtent3D& size);
-    float* loadHDRTextureData(const std::string& path, VkExtent3D& size);
+    // Returns the image packed as E5B9G9R9 texels
+    std::vector<uint32_t> loadHDRTextureData(const std::string& path, VkExtent3D& size);
     void freeImageData(void* data);
 
 }
@@ -26,12 +26,12 @@ namespace vk_utils
     }
 
     VkSubmitInfo2 submitInfo(VkCommandBufferSubmitInfo* cmd, VkSemaphoreSubmitInfo* signalSemaphoreInfo,
-                             VkSemaphoreSubmitInfo* waitSemaphoreInfo)
+                             VkSemaphoreSubmitInfo* waitSemaphoreInfo, uint32_t waitSemaphoreCount)
     {
         VkSubmitInfo2 info = {
             .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
 
-            .waitSemaphoreInfoCount = static_cast<uint32_t>(waitSemaphoreInfo == nullptr ? 0 : 1),
+            .waitSemaphoreInfoCount = waitSemaphoreInfo == nullptr ? 0 : waitSemaphoreCount,
             .pWaitSemaphoreInfos = waitSemaphoreInfo,
 
             .commandBufferInfoCount = 1,
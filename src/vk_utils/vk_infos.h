@@ -6,7 +6,7 @@ namespace vk_utils
     VkSemaphoreSubmitInfo semaphoreSubmitInfo(VkPipelineStageFlags2 stageMask, VkSemaphore semaphore);
     VkCommandBufferSubmitInfo commandBufferSubmitInfo(VkCommandBuffer cmd);
     VkSubmitInfo2 submitInfo(VkCommandBufferSubmitInfo* cmd, VkSemaphoreSubmitInfo* signalSemaphoreInfo,
-                             VkSemaphoreSubmitInfo* waitSemaphoreInfo);
+                             VkSemaphoreSubmitInfo* waitSemaphoreInfo, uint32_t waitSemaphoreCount = 1);
     VkRenderingAttachmentInfo attachmentInfo(VkImageView view, VkClearValue* clear, VkImageLayout layout);
     VkRenderingInfo renderingInfo(VkExtent2D renderExtent, VkRenderingAttachmentInfo* colorAttachment,
                                   VkRenderingAttachmentInfo* depthAttachment);
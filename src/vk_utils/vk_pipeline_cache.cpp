@@ -0,0 +1,186 @@
+#include "vk_pipeline_cache.h"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace vk_utils
+{
+    namespace
+    {
+        constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43505056; // "VPPC"
+        constexpr uint32_t PIPELINE_CACHE_FILE_VERSION = 1;
+
+        // Written in front of the driver's blob. The driver validates its own header as well but some drivers are
+        // known to crash on foreign data, so nothing reaches vkCreatePipelineCache unless this matches.
+        struct PipelineCacheFileHeader
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t vendorID;
+            uint32_t deviceID;
+            uint32_t driverVersion;
+            uint8_t driverUUID[VK_UUID_SIZE];
+            uint8_t deviceUUID[VK_UUID_SIZE];
+            uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+            uint64_t dataSize;
+        };
+
+        struct DeviceIdentity
+        {
+            VkPhysicalDeviceProperties properties;
+            VkPhysicalDeviceIDProperties ids;
+        };
+
+        DeviceIdentity queryIdentity(VkPhysicalDevice physicalDevice)
+        {
+            DeviceIdentity identity{};
+            identity.ids.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+            VkPhysicalDeviceProperties2 properties2 = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                .pNext = &identity.ids,
+            };
+            vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+            identity.properties = properties2.properties;
+            return identity;
+        }
+
+        // one file per device so that switching GPUs does not throw away the other cache
+        std::filesystem::path cacheFile(const std::filesystem::path& directory, const DeviceIdentity& identity)
+        {
+            static constexpr char hex[] = "0123456789abcdef";
+            std::string name = "pipeline_cache_";
+            for (uint8_t byte : identity.ids.deviceUUID)
+            {
+                name += hex[byte >> 4];
+                name += hex[byte & 0xf];
+            }
+            return directory / (name + ".bin");
+        }
+
+        bool isCompatible(const PipelineCacheFileHeader& header, const DeviceIdentity& identity)
+        {
+            return header.magic == PIPELINE_CACHE_MAGIC &&
+                header.version == PIPELINE_CACHE_FILE_VERSION &&
+                header.vendorID == identity.properties.vendorID &&
+                header.deviceID == identity.properties.deviceID &&
+                header.driverVersion == identity.properties.driverVersion &&
+                std::memcmp(header.driverUUID, identity.ids.driverUUID, VK_UUID_SIZE) == 0 &&
+                std::memcmp(header.deviceUUID, identity.ids.deviceUUID, VK_UUID_SIZE) == 0 &&
+                std::memcmp(header.pipelineCacheUUID, identity.properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        }
+
+        // the blob starts with VkPipelineCacheHeaderVersionOne, which has to describe the same device
+        bool isValidBlob(const std::vector<char>& data, const DeviceIdentity& identity)
+        {
+            VkPipelineCacheHeaderVersionOne header;
+            if (data.size() < sizeof(header))
+                return false;
+            std::memcpy(&header, data.data(), sizeof(header));
+            return header.headerSize >= sizeof(header) && header.headerSize <= data.size() &&
+                header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                header.vendorID == identity.properties.vendorID &&
+                header.deviceID == identity.properties.deviceID &&
+                std::memcmp(header.pipelineCacheUUID, identity.properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        }
+
+        std::vector<char> readCacheData(const std::filesystem::path& path, const DeviceIdentity& identity)
+        {
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open())
+                return {};
+
+            PipelineCacheFileHeader header{};
+            file.read(reinterpret_cast<char*>(&header), sizeof(header));
+            if (!file || !isCompatible(header, identity))
+            {
+                std::cout << "Ignoring pipeline cache " << path.string() << " from another driver or device\n";
+                return {};
+            }
+
+            // the size comes from the file as well, a truncated or corrupt one must not drive the allocation
+            std::error_code error;
+            const std::uintmax_t fileSize = std::filesystem::file_size(path, error);
+            if (error || fileSize < sizeof(header) || header.dataSize != fileSize - sizeof(header))
+            {
+                std::cout << "Ignoring corrupt pipeline cache " << path.string() << "\n";
+                return {};
+            }
+
+            std::vector<char> data(header.dataSize);
+            file.read(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!file || !isValidBlob(data, identity))
+            {
+                std::cout << "Ignoring corrupt pipeline cache " << path.string() << "\n";
+                return {};
+            }
+            return data;
+        }
+    }
+
+    VkPipelineCache loadPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice,
+                                      const std::filesystem::path& directory)
+    {
+        const DeviceIdentity identity = queryIdentity(physicalDevice);
+        const std::vector<char> data = readCacheData(cacheFile(directory, identity), identity);
+
+        VkPipelineCacheCreateInfo createInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            .initialDataSize = data.size(),
+            .pInitialData = data.empty() ? nullptr : data.data(),
+        };
+        VkPipelineCache cache = VK_NULL_HANDLE;
+        if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) != VK_SUCCESS && !data.empty())
+        {
+            // the driver refused the data after all, start over with an empty cache
+            createInfo.initialDataSize = 0;
+            createInfo.pInitialData = nullptr;
+            VK_CHECK(vkCreatePipelineCache(device, &createInfo, nullptr, &cache), "Could not create pipeline cache!");
+        }
+        return cache;
+    }
+
+    void savePipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, VkPipelineCache cache,
+                           const std::filesystem::path& directory)
+    {
+        size_t dataSize = 0;
+        VK_CHECK(vkGetPipelineCacheData(device, cache, &dataSize, nullptr), "Could not query pipeline cache size!");
+        std::vector<char> data(dataSize);
+        VK_CHECK(vkGetPipelineCacheData(device, cache, &dataSize, data.data()), "Could not read pipeline cache!");
+        data.resize(dataSize);
+
+        const DeviceIdentity identity = queryIdentity(physicalDevice);
+        PipelineCacheFileHeader header = {
+            .magic = PIPELINE_CACHE_MAGIC,
+            .version = PIPELINE_CACHE_FILE_VERSION,
+            .vendorID = identity.properties.vendorID,
+            .deviceID = identity.properties.deviceID,
+            .driverVersion = identity.properties.driverVersion,
+            .dataSize = data.size(),
+        };
+        std::memcpy(header.driverUUID, identity.ids.driverUUID, VK_UUID_SIZE);
+        std::memcpy(header.deviceUUID, identity.ids.deviceUUID, VK_UUID_SIZE);
+        std::memcpy(header.pipelineCacheUUID, identity.properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+        // written next to the target and renamed, so a crash never leaves a truncated cache behind
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        const std::filesystem::path path = cacheFile(directory, identity);
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!file)
+            {
+                std::cout << "Could not write pipeline cache " << temporary.string() << "\n";
+                return;
+            }
+        }
+        std::filesystem::rename(temporary, path, error);
+        if (error)
+            std::cout << "Could not write pipeline cache " << path.string() << ": " << error.message() << "\n";
+    }
+}
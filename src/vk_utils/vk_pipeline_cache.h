@@ -0,0 +1,15 @@
+#pragma once
+#include "types.h"
+#include "constants.h"
+
+#include <filesystem>
+
+namespace vk_utils
+{
+    // Creates a pipeline cache seeded from the file written by savePipelineCache() for this device.
+    // Files from another driver or device, or with a broken header, are ignored and an empty cache is created.
+    VkPipelineCache loadPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice,
+                                      const std::filesystem::path& directory);
+    void savePipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, VkPipelineCache cache,
+                           const std::filesystem::path& directory);
+}
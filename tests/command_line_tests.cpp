@@ -0,0 +1,143 @@
+#include "test.h"
+#include "command_line.h"
+
+using engine::LaunchSettings;
+
+namespace
+{
+    LaunchSettings parse(const std::vector<std::string>& arguments)
+    {
+        std::vector<std::string> storage = {"vkPathTracer"};
+        storage.insert(storage.end(), arguments.begin(), arguments.end());
+        std::vector<char*> argv;
+        for (std::string& argument : storage)
+            argv.push_back(argument.data());
+        return engine::parseCommandLine(static_cast<int>(argv.size()), argv.data());
+    }
+} // namespace
+
+TEST_CASE("command line modes")
+{
+    CHECK(parse({}).mode == LaunchSettings::Mode::Viewer);
+
+    const LaunchSettings offline = parse({"--headless", "--spp", "64", "--output", "out.exr"});
+    CHECK(offline.mode == LaunchSettings::Mode::Offline);
+    CHECK(offline.jobs.size() == 1);
+    CHECK(offline.jobs[0].samples == 64);
+    CHECK(offline.jobs[0].output == "out.exr");
+
+    const LaunchSettings coordinator = parse({"--headless", "--coordinator", "--port", "7400", "--tile", "128",
+                                              "--unit-spp", "0", "--output", "out.pfm"});
+    CHECK(coordinator.mode == LaunchSettings::Mode::Coordinator);
+    CHECK(coordinator.distributed.port == 7400);
+    CHECK(coordinator.distributed.tileSize == 128);
+    CHECK(coordinator.distributed.unitSamples == 0);
+
+    const LaunchSettings worker = parse({"--headless", "--worker", "render-node:7400"});
+    CHECK(worker.mode == LaunchSettings::Mode::Worker);
+    CHECK(worker.coordinatorHost == "render-node");
+    CHECK(worker.distributed.port == 7400);
+    CHECK(worker.jobs.empty());
+}
+
+TEST_CASE("command line errors")
+{
+    CHECK_THROWS(parse({"--spp", "64"}), "The render options need --headless");
+    CHECK_THROWS(parse({"--headless", "--samples", "64"}), "Unknown option --samples");
+    CHECK_THROWS(parse({"--headless", "--spp"}), "Missing value for --spp");
+    CHECK_THROWS(parse({"--headless", "--fov", "180"}), "The field of view is out of (0, 180) degrees");
+    CHECK_THROWS(parse({"--headless", "--output", "out.jpg"}), "Unsupported output format '.jpg'");
+    CHECK_THROWS(parse({"--headless", "--position", "1,2"}), "--position needs three comma separated numbers");
+    CHECK_THROWS(parse({"--headless", "--material", "0:shininess=2"}), "Unknown material property 'shininess'");
+    CHECK_THROWS(parse({"--headless", "--coordinator"}), "Distributed renders write the linear radiance");
+    CHECK_THROWS(parse({"--headless", "--worker", "render-node"}), "A worker only takes the host:port");
+    CHECK_THROWS(parse({"--headless", "--worker", "render-node:7400", "--spp", "4"}), "A worker only takes");
+    CHECK_THROWS(parse({"--headless", "--worker", "render-node:70000"}), "70000 is not a port");
+}
+
+TEST_CASE("command line integers are parsed exactly")
+{
+    // above 2^24 a float would round them
+    CHECK(parse({"--headless", "--spp", "16777217"}).jobs[0].samples == 16777217);
+    CHECK(parse({"--headless", "--spp", "4294967295"}).jobs[0].samples == 4294967295u);
+    CHECK(parse({"--headless", "--bounces", "0"}).jobs[0].bounces == 0);
+
+    CHECK_THROWS(parse({"--headless", "--spp", "4294967296"}),
+                 "--spp needs an integer of at least 1, got '4294967296'");
+    CHECK_THROWS(parse({"--headless", "--spp", "0"}), "--spp needs an integer of at least 1");
+    CHECK_THROWS(parse({"--headless", "--spp", "-1"}), "--spp needs an integer");
+    CHECK_THROWS(parse({"--headless", "--spp", "12x"}), "--spp needs an integer");
+    CHECK_THROWS(parse({"--headless", "--spp", "1e3"}), "--spp needs an integer");
+    CHECK_THROWS(parse({"--headless", "--width", ""}), "--width needs an integer");
+}
+
+TEST_CASE("command line material overrides of a mesh are merged")
+{
+    const LaunchSettings launch = parse({"--headless", "--material", "2:roughness=0.5", "--material",
+                                         "2:color=1,0,0", "--material", "0:emission=4"});
+    const std::vector<engine::MaterialOverride>& materials = launch.jobs[0].materials;
+    CHECK(materials.size() == 2);
+    CHECK(materials[0].mesh == 2);
+    CHECK(materials[0].roughness == 0.5f);
+    CHECK(materials[0].color.has_value() && materials[0].color->x == 1.0f);
+    CHECK(!materials[0].metallic.has_value());
+    CHECK(materials[1].mesh == 0);
+    CHECK(materials[1].emissiveStrength == 4.0f);
+}
+
+TEST_CASE("job files inherit the options of the previous line")
+{
+    const tests::TempFile jobs("vkPathTracerTests_jobs.txt",
+                               "# a short turntable\n"
+                               "--scene a.obj,b.obj --output frame0.exr --material 0:roughness=0.2\n"
+                               "\n"
+                               "--position 1,0,0 --output \"frame 1.exr\"  # quoted values keep their spaces\n"
+                               "--spp 32 --output frame2.exr\n");
+    engine::OfflineRenderSettings defaults;
+    defaults.samples = 8;
+    defaults.materials = {{.mesh = 5, .metallic = 1.0f}};
+
+    const std::vector<engine::OfflineRenderSettings> parsed = engine::parseJobFile(jobs.path(), defaults);
+    CHECK(parsed.size() == 3);
+    CHECK(parsed[0].scene.models.size() == 2);
+    CHECK(parsed[0].output == "frame0.exr");
+    CHECK(parsed[0].samples == 8);
+    CHECK(parsed[0].materials.size() == 2);
+
+    CHECK(parsed[1].scene.models.size() == 2);
+    CHECK(parsed[1].cameraPosition.x == 1.0f);
+    CHECK(parsed[1].output == "frame 1.exr");
+    // material overrides only apply to the line naming them
+    CHECK(parsed[1].materials.size() == 1 && parsed[1].materials[0].mesh == 5);
+
+    CHECK(parsed[2].cameraPosition.x == 1.0f);
+    CHECK(parsed[2].samples == 32);
+}
+
+TEST_CASE("job files take their defaults from the command line")
+{
+    const tests::TempFile jobs("vkPathTracerTests_batch.txt", "--output a.exr\n--output b.exr --spp 4\n");
+    const LaunchSettings launch = parse({"--headless", "--batch", jobs.path(), "--spp", "16", "--width", "64"});
+    CHECK(launch.jobs.size() == 2);
+    CHECK(launch.jobs[0].samples == 16 && launch.jobs[0].width == 64);
+    CHECK(launch.jobs[1].samples == 4 && launch.jobs[1].width == 64);
+}
+
+TEST_CASE("job file errors name their line")
+{
+    const tests::TempFile invalid("vkPathTracerTests_invalid.txt", "--output a.exr\n\n# comment\n--fov 0\n");
+    CHECK_THROWS(engine::parseJobFile(invalid.path(), {}),
+                 std::format("{}:4: The field of view is out of (0, 180) degrees", invalid.path()));
+
+    const tests::TempFile unknown("vkPathTracerTests_unknown.txt", "--output a.exr\n--samples 4\n");
+    CHECK_THROWS(engine::parseJobFile(unknown.path(), {}),
+                 std::format("{}:2: Unknown option --samples", unknown.path()));
+
+    const tests::TempFile resolution("vkPathTracerTests_resolution.txt", "--width 64\n--width 64\n--height 32\n");
+    CHECK_THROWS(engine::parseJobFile(resolution.path(), {}),
+                 std::format("{}:3: All jobs of a batch share the resolution of the first one", resolution.path()));
+
+    const tests::TempFile empty("vkPathTracerTests_empty.txt", "# nothing to render\n\n");
+    CHECK_THROWS(engine::parseJobFile(empty.path(), {}), "has no jobs!");
+    CHECK_THROWS(engine::parseJobFile(empty.path() + ".missing", {}), "Could not open the job file");
+}
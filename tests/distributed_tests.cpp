@@ -0,0 +1,129 @@
+#include "test.h"
+#include "distributed.h"
+
+namespace
+{
+    // rgba tile whose texels all hold the same radiance and sample count
+    std::vector<float> uniformTile(uint32_t tileSize, float radiance, float samples)
+    {
+        std::vector<float> texels(static_cast<size_t>(tileSize) * tileSize * 4, radiance);
+        for (size_t i = 3; i < texels.size(); i += 4)
+            texels[i] = samples;
+        return texels;
+    }
+} // namespace
+
+TEST_CASE("message readers stop at the end of the message")
+{
+    network::MessageWriter writer;
+    writer.write(uint32_t{7}).write(uint16_t{3});
+    network::MessageReader reader(writer.data());
+    CHECK(reader.read<uint32_t>() == 7);
+    CHECK_THROWS(reader.read<uint32_t>(), "Truncated message!");
+
+    network::MessageReader exact(writer.data());
+    CHECK(exact.read<uint32_t>() == 7);
+    CHECK(exact.read<uint16_t>() == 3);
+    CHECK_THROWS(exact.read<uint8_t>(), "Truncated message!");
+
+    network::MessageReader empty({});
+    CHECK_THROWS(empty.readString(), "Truncated message!");
+}
+
+TEST_CASE("message readers check vector counts before allocating")
+{
+    // a count far beyond the message, allocating it first would exhaust the memory
+    network::MessageWriter oversized;
+    oversized.write(uint64_t{1} << 60).write(1.0f);
+    network::MessageReader reader(oversized.data());
+    CHECK_THROWS(reader.readVector<float>(), "Truncated message!");
+
+    network::MessageWriter truncated;
+    truncated.write(uint64_t{3}).write(1.0f).write(2.0f);
+    network::MessageReader truncatedReader(truncated.data());
+    CHECK_THROWS(truncatedReader.readVector<float>(), "Truncated message!");
+
+    network::MessageWriter writer;
+    writer.write(std::vector<float>{1.0f, 2.0f, 3.0f}).write(std::string()).write(std::string("tile"));
+    network::MessageReader valid(writer.data());
+    CHECK(valid.readVector<float>() == std::vector<float>({1.0f, 2.0f, 3.0f}));
+    CHECK(valid.readString().empty());
+    CHECK(valid.readString() == "tile");
+}
+
+TEST_CASE("jobs survive the protocol")
+{
+    engine::OfflineRenderSettings job;
+    job.scene.models = {"a.obj", "dir with spaces/b.obj"};
+    job.scene.envMap = "sky.hdr";
+    job.materials = {{.mesh = 3, .roughness = 0.25f}, {.mesh = 1, .color = glm::vec3(1.0f, 0.5f, 0.0f)}};
+    job.cameraPosition = {1.0f, 2.0f, 3.0f};
+    job.fov = 50.0f;
+    job.width = 640;
+    job.height = 360;
+    job.samples = 1024;
+    job.bounces = 8;
+    job.output = "frame.exr";
+
+    network::MessageWriter writer;
+    engine::writeJob(writer, job);
+    network::MessageReader reader(writer.data());
+    const engine::OfflineRenderSettings read = engine::readJob(reader);
+    CHECK(read.scene.models == job.scene.models);
+    CHECK(read.scene.envMap == job.scene.envMap);
+    CHECK(read.materials.size() == 2);
+    CHECK(read.materials[0].mesh == 3 && read.materials[0].roughness == 0.25f);
+    CHECK(!read.materials[0].color.has_value() && !read.materials[0].metallic.has_value());
+    CHECK(read.materials[1].mesh == 1 && read.materials[1].color.has_value());
+    CHECK(read.materials[1].color->y == 0.5f && !read.materials[1].roughness.has_value());
+    CHECK(read.cameraPosition.z == 3.0f);
+    CHECK(read.fov == 50.0f);
+    CHECK(read.width == 640 && read.height == 360 && read.samples == 1024 && read.bounces == 8);
+    CHECK(read.output == job.output);
+
+    // a message cut anywhere fails instead of reading past its end
+    for (size_t size = 0; size < writer.data().size(); size += 7)
+    {
+        network::MessageReader truncated({writer.data().begin(), writer.data().begin() + size});
+        CHECK_THROWS(engine::readJob(truncated), "Truncated message!");
+    }
+}
+
+TEST_CASE("tiles are merged weighted by their sample counts")
+{
+    engine::OfflineRenderSettings job;
+    job.width = 6;
+    job.height = 5;
+    constexpr uint32_t tileSize = 4;
+
+    engine::JobAccumulation accumulation;
+    // two sample ranges of the first tile
+    engine::mergeTile(accumulation, job, {.originX = 0, .originY = 0}, tileSize, uniformTile(tileSize, 1.0f, 2.0f));
+    engine::mergeTile(accumulation, job, {.originX = 0, .originY = 0}, tileSize, uniformTile(tileSize, 4.0f, 6.0f));
+    CHECK(accumulation.samples.size() == 30);
+    CHECK(accumulation.radiance.size() == 90);
+    // the other tiles cross the image borders
+    engine::mergeTile(accumulation, job, {.originX = 4, .originY = 0}, tileSize, uniformTile(tileSize, 5.0f, 1.0f));
+    engine::mergeTile(accumulation, job, {.originX = 0, .originY = 4}, tileSize, uniformTile(tileSize, 6.0f, 1.0f));
+    engine::mergeTile(accumulation, job, {.originX = 4, .originY = 4}, tileSize, uniformTile(tileSize, 7.0f, 0.0f));
+    CHECK(accumulation.samples.size() == 30);
+
+    const std::vector<float> rgb = engine::resolveAccumulation(accumulation);
+    CHECK(rgb.size() == 90);
+    for (uint32_t y = 0; y < job.height; y++)
+    {
+        for (uint32_t x = 0; x < job.width; x++)
+        {
+            const size_t pixel = static_cast<size_t>(y) * job.width + x;
+            float expected = (1.0f * 2.0f + 4.0f * 6.0f) / 8.0f;
+            if (x >= 4 && y >= 4)
+                expected = 0.0f; // no samples landed there
+            else if (x >= 4)
+                expected = 5.0f;
+            else if (y >= 4)
+                expected = 6.0f;
+            for (uint32_t c = 0; c < 3; c++)
+                CHECK_NEAR(rgb[pixel * 3 + c], expected, 1e-6);
+        }
+    }
+}
@@ -0,0 +1,149 @@
+#include "test.h"
+#include "path_tracing/geometry.h"
+#include <algorithm>
+#include <random>
+
+namespace
+{
+    using path_tracing::Geometry;
+    using path_tracing::Triangle;
+
+    constexpr float MISS = 1e10f;
+
+    // closest hit over every triangle without the BVH, the reference for Geometry::occluded
+    float intersect(const Geometry& geometry, const glm::vec3& origin, const glm::vec3& direction)
+    {
+        float closest = MISS;
+        for (const Triangle& tri : geometry.triangles)
+        {
+            const glm::vec3 v0 = geometry.vertices[tri.v0].position;
+            const glm::vec3 v1v0 = geometry.vertices[tri.v1].position - v0;
+            const glm::vec3 v2v0 = geometry.vertices[tri.v2].position - v0;
+            const glm::vec3 rov0 = origin - v0;
+            const glm::vec3 n = glm::cross(v1v0, v2v0);
+            const glm::vec3 q = glm::cross(rov0, direction);
+            const float d = 1.0f / glm::dot(direction, n);
+            const float u = d * glm::dot(-q, v2v0);
+            const float v = d * glm::dot(q, v1v0);
+            const float dist = d * glm::dot(-n, rov0);
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && dist > 0.0f)
+                closest = std::min(closest, dist);
+        }
+        return closest;
+    }
+
+    void addTriangle(Geometry& geometry, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+    {
+        const auto first = static_cast<uint32_t>(geometry.vertices.size());
+        geometry.vertices.push_back({.position = v0});
+        geometry.vertices.push_back({.position = v1});
+        geometry.vertices.push_back({.position = v2});
+        geometry.triangles.push_back({.v0 = first, .v1 = first + 1, .v2 = first + 2});
+    }
+
+    // two grids of quads facing each other, so that most rays cross several leaves
+    Geometry makeGrids(uint32_t size)
+    {
+        Geometry geometry;
+        for (float z : {0.0f, 2.0f})
+        {
+            for (uint32_t y = 0; y < size; y++)
+            {
+                for (uint32_t x = 0; x < size; x++)
+                {
+                    const glm::vec3 corner(static_cast<float>(x), static_cast<float>(y), z);
+                    addTriangle(geometry, corner, corner + glm::vec3(1, 0, 0), corner + glm::vec3(1, 1, 0));
+                    addTriangle(geometry, corner, corner + glm::vec3(1, 1, 0), corner + glm::vec3(0, 1, 0));
+                }
+            }
+        }
+        return geometry;
+    }
+
+    Geometry makeSoup(uint32_t count, std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> position(-4.0f, 4.0f);
+        std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+        Geometry geometry;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const glm::vec3 center(position(rng), position(rng), position(rng));
+            addTriangle(geometry, center + glm::vec3(offset(rng), offset(rng), offset(rng)),
+                        center + glm::vec3(offset(rng), offset(rng), offset(rng)),
+                        center + glm::vec3(offset(rng), offset(rng), offset(rng)));
+        }
+        return geometry;
+    }
+
+    // rays from outside of the bounds aimed at every triangle and at random points, the any-hit traversal has to
+    // report a hit before tMax exactly when the closest hit is before tMax, on both sides of the closest hit
+    void checkOcclusion(const Geometry& geometry, std::mt19937& rng)
+    {
+        const glm::vec3 center = (geometry.nodes[0].aabbMin + geometry.nodes[0].aabbMax) * 0.5f;
+        const float radius = glm::length(geometry.nodes[0].aabbMax - geometry.nodes[0].aabbMin) + 1.0f;
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        uint32_t hits = 0;
+        for (const Triangle& tri : geometry.triangles)
+        {
+            const glm::vec3 target = (geometry.vertices[tri.v0].position + geometry.vertices[tri.v1].position +
+                geometry.vertices[tri.v2].position) / 3.0f;
+            const glm::vec3 jitter = glm::vec3(unit(rng), unit(rng), unit(rng)) * radius;
+            for (const glm::vec3& aim : {target, center + jitter})
+            {
+                const glm::vec3 origin = center + glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng))) * radius;
+                const glm::vec3 direction = glm::normalize(aim - origin);
+
+                const float hit = intersect(geometry, origin, direction);
+                const float tMax = hit < MISS ? hit : radius * 4.0f;
+                CHECK(geometry.occluded(origin, direction, tMax * 0.5f) == (hit < tMax * 0.5f));
+                CHECK(geometry.occluded(origin, direction, tMax * 2.0f) == (hit < tMax * 2.0f));
+                hits += hit < MISS;
+            }
+        }
+        // the rays aimed at the triangles have to hit something
+        CHECK(hits >= geometry.triangles.size());
+    }
+} // namespace
+
+TEST_CASE("occluded agrees with the closest hit on a single leaf")
+{
+    std::mt19937 rng(1);
+    Geometry geometry = makeGrids(2);
+    geometry.buildBVH(0);
+    CHECK(geometry.nodes.size() == 1);
+    checkOcclusion(geometry, rng);
+}
+
+TEST_CASE("occluded agrees with the closest hit on facing grids")
+{
+    std::mt19937 rng(2);
+    Geometry geometry = makeGrids(8);
+    geometry.buildBVH(6);
+    CHECK(geometry.nodes.size() > 1);
+    checkOcclusion(geometry, rng);
+}
+
+TEST_CASE("occluded agrees with the closest hit on a triangle soup")
+{
+    std::mt19937 rng(3);
+    Geometry geometry = makeSoup(200, rng);
+    geometry.buildBVH(8);
+    checkOcclusion(geometry, rng);
+}
+
+TEST_CASE("occluded ignores hits behind the origin and past tMax")
+{
+    Geometry geometry = makeGrids(4);
+    geometry.buildBVH(3);
+    const glm::vec3 between(1.5f, 1.5f, 1.0f);
+    const glm::vec3 down(0.0f, 0.0f, -1.0f);
+    // both grids are one unit away from a point between them
+    CHECK(geometry.occluded(between, down, 2.0f));
+    CHECK(!geometry.occluded(between, down, 0.5f));
+    CHECK(geometry.occluded(between, -down, 2.0f));
+    CHECK(!geometry.occluded(between, -down, 0.5f));
+    // below the bottom grid and pointing away from both
+    CHECK(!geometry.occluded(glm::vec3(1.5f, 1.5f, -1.0f), down, 100.0f));
+    CHECK(!geometry.occluded(glm::vec3(10.0f, 1.5f, 1.0f), down, 100.0f));
+}
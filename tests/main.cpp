@@ -0,0 +1,23 @@
+#include "test.h"
+#include <iostream>
+
+int main()
+{
+    size_t failures = 0;
+    for (const auto& [name, run] : tests::registry())
+    {
+        try
+        {
+            run();
+        }
+        catch (const std::exception& e)
+        {
+            failures++;
+            std::cerr << "FAILED " << name << " : " << e.what() << std::endl;
+        }
+    }
+
+    std::cout << tests::registry().size() - failures << " / " << tests::registry().size() << " tests passed"
+        << std::endl;
+    return failures == 0 ? 0 : 1;
+}
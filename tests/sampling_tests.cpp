@@ -0,0 +1,80 @@
+#include "test.h"
+#include "path_tracing/sampling.h"
+#include <numeric>
+
+namespace
+{
+    using path_tracing::AliasEntry;
+
+    // probability of drawing each index, the column is picked uniformly and then kept or swapped for its alias
+    std::vector<double> drawProbabilities(const std::vector<AliasEntry>& table)
+    {
+        std::vector<double> probabilities(table.size(), 0.0);
+        for (const AliasEntry& entry : table)
+        {
+            const size_t column = &entry - table.data();
+            probabilities[column] += entry.probability / static_cast<double>(table.size());
+            probabilities[entry.alias] += (1.0 - entry.probability) / static_cast<double>(table.size());
+        }
+        return probabilities;
+    }
+
+    void checkTable(const std::vector<float>& weights)
+    {
+        const std::vector<AliasEntry> table = path_tracing::buildAliasTable(weights);
+        CHECK(table.size() == weights.size());
+
+        const double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+        const std::vector<double> probabilities = drawProbabilities(table);
+        double pmfSum = 0.0;
+        for (size_t i = 0; i < table.size(); i++)
+        {
+            CHECK(table[i].alias < table.size());
+            CHECK(table[i].probability >= 0.0f && table[i].probability <= 1.0f);
+            CHECK_NEAR(table[i].pmf, weights[i] / sum, 1e-6);
+            CHECK_NEAR(probabilities[i], weights[i] / sum, 1e-6);
+            pmfSum += table[i].pmf;
+        }
+        CHECK_NEAR(pmfSum, 1.0, 1e-5);
+    }
+} // namespace
+
+TEST_CASE("alias tables reproduce their weights")
+{
+    checkTable({1.0f, 2.0f, 3.0f, 4.0f});
+    checkTable({0.1f, 100.0f, 0.001f, 5.0f, 5.0f, 0.0f, 42.0f});
+
+    std::vector<float> ramp(1000);
+    std::iota(ramp.begin(), ramp.end(), 0.0f);
+    checkTable(ramp);
+}
+
+TEST_CASE("zero weight entries are never drawn")
+{
+    const std::vector<float> weights = {0.0f, 3.0f, 0.0f, 1.0f};
+    const std::vector<AliasEntry> table = path_tracing::buildAliasTable(weights);
+    const std::vector<double> probabilities = drawProbabilities(table);
+    CHECK(table[0].pmf == 0.0f && table[2].pmf == 0.0f);
+    CHECK(probabilities[0] == 0.0 && probabilities[2] == 0.0);
+}
+
+TEST_CASE("alias tables of null weights are uniform")
+{
+    const std::vector<AliasEntry> table = path_tracing::buildAliasTable({0.0f, 0.0f, 0.0f, 0.0f});
+    CHECK(table.size() == 4);
+    for (uint32_t i = 0; i < table.size(); i++)
+    {
+        CHECK(table[i].probability == 1.0f);
+        CHECK(table[i].alias == i);
+        CHECK(table[i].pmf == 0.25f);
+    }
+}
+
+TEST_CASE("alias tables of a single or no entry")
+{
+    const std::vector<AliasEntry> single = path_tracing::buildAliasTable({7.0f});
+    CHECK(single.size() == 1);
+    CHECK(single[0].probability == 1.0f && single[0].alias == 0 && single[0].pmf == 1.0f);
+
+    CHECK(path_tracing::buildAliasTable({}).empty());
+}
@@ -0,0 +1,80 @@
+#include "test.h"
+#include "renderer/scene_heap.h"
+
+using renderer::SceneHeap;
+
+TEST_CASE("scene heap ranges are aligned and rounded up")
+{
+    SceneHeap heap;
+    heap.reset(256);
+
+    const auto small = heap.allocate(10);
+    CHECK(small && small->offset == 0 && small->size == 16);
+    const auto aligned = heap.allocate(40, 64);
+    CHECK(aligned && aligned->offset == 64 && aligned->size == 64);
+    // empty streams still get a range
+    const auto empty = heap.allocate(0);
+    CHECK(empty && empty->offset == 16 && empty->size == 16);
+    CHECK(heap.used() == 96);
+}
+
+TEST_CASE("scene heap reports when it has to grow")
+{
+    SceneHeap heap;
+    heap.reset(0);
+    CHECK(!heap.allocate(1));
+
+    heap.reset(256);
+    CHECK(heap.allocate(100, 128));
+    // 128 bytes are left but not in one aligned block of 256
+    CHECK(!heap.allocate(129));
+    CHECK(!heap.allocate(64, 256));
+    CHECK(heap.allocate(128));
+    CHECK(!heap.allocate(1));
+    CHECK(heap.used() == heap.capacity());
+}
+
+TEST_CASE("scene heap merges freed neighbours")
+{
+    SceneHeap heap;
+    heap.reset(256);
+    const auto a = heap.allocate(64);
+    const auto b = heap.allocate(64);
+    const auto c = heap.allocate(64);
+    const auto d = heap.allocate(64);
+    CHECK(a && b && c && d);
+
+    // two free blocks that are not neighbours
+    heap.free(*a);
+    heap.free(*c);
+    CHECK(heap.used() == 128);
+    CHECK(!heap.allocate(128));
+
+    // b merges with the blocks on both sides
+    heap.free(*b);
+    const auto merged = heap.allocate(192);
+    CHECK(merged && merged->offset == 0 && merged->size == 192);
+    CHECK(heap.used() == 256);
+}
+
+TEST_CASE("scene heap growth keeps ranges and frees the new space")
+{
+    SceneHeap heap;
+    heap.reset(64);
+    const auto first = heap.allocate(32);
+    CHECK(first && !heap.allocate(64));
+
+    heap.grow(128);
+    CHECK(heap.capacity() == 128);
+    CHECK(heap.used() == 32);
+    // the free tail of the old capacity merges with the new space
+    const auto second = heap.allocate(96);
+    CHECK(second && second->offset == 32);
+
+    heap.grow(64);
+    CHECK(heap.capacity() == 128);
+    heap.free(*first);
+    heap.free(*second);
+    CHECK(heap.used() == 0);
+    CHECK(heap.allocate(128));
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <cmath>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tests
+{
+    // Thrown by a failed check, the runner reports it and moves on to the next test
+    struct Failure : std::runtime_error
+    {
+        using std::runtime_error::runtime_error;
+    };
+
+    struct TestCase
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    inline std::vector<TestCase>& registry()
+    {
+        static std::vector<TestCase> testCases;
+        return testCases;
+    }
+
+    struct Registrar
+    {
+        Registrar(const char* name, void (*run)())
+        {
+            registry().push_back({name, run});
+        }
+    };
+
+    [[noreturn]] inline void fail(const char* file, int line, const std::string& message)
+    {
+        throw Failure(std::format("{}:{}: {}", file, line, message));
+    }
+
+    // File in the temporary directory, removed with the object
+    class TempFile
+    {
+    public:
+        TempFile(const std::string& name, std::string_view content)
+            : path_(std::filesystem::temp_directory_path() / name)
+        {
+            std::ofstream(path_, std::ios::binary).write(content.data(), static_cast<std::streamsize>(content.size()));
+        }
+
+        ~TempFile()
+        {
+            std::error_code error;
+            std::filesystem::remove(path_, error);
+        }
+
+        TempFile(const TempFile&) = delete;
+        TempFile& operator=(const TempFile&) = delete;
+
+        std::string path() const { return path_.string(); }
+
+    private:
+        std::filesystem::path path_;
+    };
+} // tests
+
+#define TEST_CONCAT_IMPL(a, b) a##b
+#define TEST_CONCAT(a, b) TEST_CONCAT_IMPL(a, b)
+
+#define TEST_CASE(name) \
+    static void TEST_CONCAT(testCase, __LINE__)(); \
+    static const tests::Registrar TEST_CONCAT(registrar, __LINE__)(name, TEST_CONCAT(testCase, __LINE__)); \
+    static void TEST_CONCAT(testCase, __LINE__)()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) \
+            tests::fail(__FILE__, __LINE__, #condition); \
+    } while (false)
+
+#define CHECK_NEAR(value, expected, tolerance) \
+    do { \
+        const double checkValue = (value); \
+        const double checkExpected = (expected); \
+        if (!(std::abs(checkValue - checkExpected) <= (tolerance))) \
+            tests::fail(__FILE__, __LINE__, std::format("{} is {}, expected {}", #value, checkValue, checkExpected)); \
+    } while (false)
+
+// expects the expression to throw an exception whose message contains text
+#define CHECK_THROWS(expression, text) \
+    do { \
+        bool checkThrown = false; \
+        try \
+        { \
+            (void)(expression); \
+        } \
+        catch (const tests::Failure&) \
+        { \
+            throw; \
+        } \
+        catch (const std::exception& e) \
+        { \
+            checkThrown = true; \
+            if (std::string(e.what()).find(text) == std::string::npos) \
+                tests::fail(__FILE__, __LINE__, std::format("{} threw \"{}\"", #expression, e.what())); \
+        } \
+        if (!checkThrown) \
+            tests::fail(__FILE__, __LINE__, std::format("{} did not throw", #expression)); \
+    } while (false)
@@ -0,0 +1,91 @@
+#include "test.h"
+#include "vk_utils/vk_images.h"
+#include <glm/gtc/packing.hpp>
+
+namespace
+{
+    std::string radianceHeader(uint32_t width, uint32_t height)
+    {
+        return std::format("#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y {} +X {}\n", height, width);
+    }
+
+    void appendBytes(std::string& file, std::initializer_list<int> bytes)
+    {
+        for (int byte : bytes)
+            file.push_back(static_cast<char>(byte));
+    }
+
+    // eight texels of the new RLE layout, the green channel is stored literally and the others as runs
+    std::string rleImage()
+    {
+        std::string file = radianceHeader(8, 1);
+        appendBytes(file, {2, 2, 0, 8});
+        appendBytes(file, {128 + 8, 128});
+        appendBytes(file, {8, 0, 16, 32, 48, 64, 80, 96, 112});
+        appendBytes(file, {128 + 4, 32, 4, 1, 2, 3, 4});
+        appendBytes(file, {128 + 8, 129});
+        return file;
+    }
+
+    void checkTexel(uint32_t packed, const glm::vec3& expected)
+    {
+        const glm::vec3 color = glm::unpackF3x9_E1x5(packed);
+        CHECK_NEAR(color.x, expected.x, 1e-3);
+        CHECK_NEAR(color.y, expected.y, 1e-3);
+        CHECK_NEAR(color.z, expected.z, 1e-3);
+    }
+} // namespace
+
+TEST_CASE("flat HDR scanlines decode to shared exponent texels")
+{
+    std::string file = radianceHeader(4, 2);
+    appendBytes(file, {128, 64, 32, 129, 255, 0, 0, 0, 128, 128, 128, 136, 64, 64, 64, 128});
+    appendBytes(file, {0, 0, 0, 0, 1, 1, 1, 129, 192, 0, 0, 130, 0, 255, 0, 127});
+    const tests::TempFile hdr("vkPathTracerTests_flat.hdr", file);
+
+    VkExtent3D size{};
+    const std::vector<uint32_t> texels = vk_utils::loadHDRTextureData(hdr.path(), size);
+    CHECK(size.width == 4 && size.height == 2);
+    CHECK(texels.size() == 8);
+    checkTexel(texels[0], glm::vec3(1.0f, 0.5f, 0.25f));
+    // a zero exponent is black whatever the mantissas
+    checkTexel(texels[1], glm::vec3(0.0f));
+    checkTexel(texels[2], glm::vec3(128.0f));
+    checkTexel(texels[3], glm::vec3(0.25f));
+    checkTexel(texels[4], glm::vec3(0.0f));
+    checkTexel(texels[5], glm::vec3(1.0f / 128.0f));
+    checkTexel(texels[6], glm::vec3(3.0f, 0.0f, 0.0f));
+    checkTexel(texels[7], glm::vec3(0.0f, 255.0f / 512.0f, 0.0f));
+}
+
+TEST_CASE("RLE HDR scanlines decode their runs")
+{
+    const tests::TempFile hdr("vkPathTracerTests_rle.hdr", rleImage());
+
+    VkExtent3D size{};
+    const std::vector<uint32_t> texels = vk_utils::loadHDRTextureData(hdr.path(), size);
+    CHECK(size.width == 8 && size.height == 1);
+    CHECK(texels.size() == 8);
+    const float blues[8] = {32, 32, 32, 32, 1, 2, 3, 4};
+    for (uint32_t x = 0; x < 8; x++)
+        checkTexel(texels[x], glm::vec3(1.0f, static_cast<float>(x * 16) / 128.0f, blues[x] / 128.0f));
+
+    // stb decodes the same file through its own path
+    int width, height, channels;
+    float* pixels = stbi_loadf(hdr.path().c_str(), &width, &height, &channels, 3);
+    CHECK(pixels != nullptr && width == 8 && height == 1);
+    for (uint32_t x = 0; x < 8; x++)
+        CHECK(texels[x] == glm::packF3x9_E1x5(glm::vec3(pixels[x * 3], pixels[x * 3 + 1], pixels[x * 3 + 2])));
+    stbi_image_free(pixels);
+}
+
+TEST_CASE("truncated or LDR images throw")
+{
+    const std::string file = rleImage();
+    const tests::TempFile truncated("vkPathTracerTests_truncated.hdr", file.substr(0, file.size() - 6));
+    VkExtent3D size{};
+    CHECK_THROWS(vk_utils::loadHDRTextureData(truncated.path(), size), "failed to load texture image");
+
+    const tests::TempFile ldr("vkPathTracerTests_ldr.hdr", "P3\n1 1\n255\n0 0 0\n");
+    CHECK_THROWS(vk_utils::loadHDRTextureData(ldr.path(), size), "Trying to load LDR image as HDR");
+}